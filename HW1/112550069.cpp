@@ -3,7 +3,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <signal.h>
+#include <spawn.h>
 using namespace std;
 
 struct Program{
@@ -102,35 +104,6 @@ static vector<string> tokenize(string command){
     return command_tokens;
 }
 
-static void redirect_handler(Program program){
-        if(!program.infile.empty()){
-            int file_descriptor = open(program.infile.c_str(), O_RDONLY); // system call
-            // file_descriptor: pointer of I/O space, the opened file content will be read from this space
-            // STDIN_FILENO = 0, STDOUT_FILENO = 1, STDERR_FILENO = 2 
-            if(file_descriptor < 0){
-                cerr << "[Error] open infile failed: " << "\n";
-                exit(1); // normal error
-            }
-            if(dup2(file_descriptor, STDIN_FILENO) < 0){ // duplicate file channel's work to stdin
-                cerr << "[Error] duplicate infile to STDIN failed: " << "\n";
-                exit(1);
-            }
-            close(file_descriptor);
-        }
-        if(!program.outfile.empty()){
-            int file_descriptor = open(program.outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if(file_descriptor < 0){
-                cerr << "[Error] open outfile failed: " << "\n";
-                exit(1);
-            }
-            if(dup2(file_descriptor, STDOUT_FILENO) < 0){
-                cerr << "[Error] duplicate outfile to STDOUT failed: " << "\n";
-                exit(1);
-            }
-            close(file_descriptor);
-        }
-}
-
 static void sigchld_handler(int) {
     while (waitpid(-1, nullptr, WNOHANG) > 0) {} // non-blocking
     // waitpid(pid, &status, 0) => parent will wait untill child process ends
@@ -149,28 +122,485 @@ static vector<char*> args_to_argv(const Program& program){
     return argv;
 }
 
-static void run_program(Program program){
-    if(program.program_name.empty()) return;
-    pid_t pid = fork(); // forked process starts from here
-    if(pid < 0) {
-        cerr << ("[Error] Fork Failed");
-        exit(-1); // not standard error
-    }
-    if(pid == 0){ // child process, exeute the program
-        signal(SIGINT, SIG_DFL);
-        redirect_handler(program);
-        vector<char*> argv = args_to_argv(program);
-        int execvp_status = execvp(program.program_name.c_str(), argv.data()); // replace current process with excuted program
-        if(execvp_status < 0){
-            cerr << "[Error] execvp failed: " << "\n";
+// ---------------- background jobs ----------------
+// sigchld_handler reaps every child, so a job whose pid can no longer be waited for is done
+struct Job{
+    int id;
+    pid_t pid;
+    string command;
+};
+static vector<Job> jobs;
+
+static string program_to_string(const Program& program){
+    string command = program.program_name;
+    for(const string& arg: program.args) command += " " + arg;
+    return command;
+}
+
+static void add_job(pid_t pid, const Program& program){
+    int id = jobs.empty() ? 1 : jobs.back().id + 1;
+    jobs.push_back(Job{id, pid, program_to_string(program)});
+}
+
+// ---------------- command hash ----------------
+// Like bash's hash: a command name is searched in PATH once and the full path is kept, so
+// a launch is a single execve of that path (posix_spawn) instead of execvp trying every PATH
+// directory in turn. The table is dropped when PATH changes, and an entry whose file is gone
+// (ENOENT at launch) is searched again. `hash` shows it, `hash -r` empties it.
+struct HashEntry{
+    string path;
+    int hits;
+};
+static unordered_map<string, HashEntry> command_hash;
+static string hashed_path_variable; // PATH the table was built with
+
+// an executable file named like program_name, found the way execvp would ("" if there is none)
+static string find_in_path(const string& name){
+    struct stat file_stat;
+    if(name.find('/') != string::npos){
+        return (stat(name.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode) && access(name.c_str(), X_OK) == 0) ? name : "";
+    }
+    const char* path = getenv("PATH");
+    string dirs = path ? path : "/bin:/usr/bin";
+    size_t start = 0;
+    while(start <= dirs.size()){
+        size_t end = dirs.find(':', start);
+        if(end == string::npos) end = dirs.size();
+        string dir = dirs.substr(start, end - start);
+        string candidate = (dir.empty() ? "." : dir) + "/" + name; // empty entry: current directory
+        if(stat(candidate.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode) && access(candidate.c_str(), X_OK) == 0){
+            return candidate;
         }
-        exit(127);
-    } else { // parent process, pid is child process' id
-        if(!program.background){ // wait for child process
-            waitpid(pid, nullptr, 0);
-        } else {
-            // no need to do any waiting
+        start = end + 1;
+    }
+    return "";
+}
+
+static void check_hashed_path_variable(){
+    const char* path = getenv("PATH");
+    string current = path ? path : "";
+    if(current != hashed_path_variable){
+        command_hash.clear();
+        hashed_path_variable = current;
+    }
+}
+
+// full path to launch name with ("" if there is none), a name with '/' is used as is
+static string resolve_command(const string& name, bool count_hit){
+    if(name.find('/') != string::npos) return name;
+    check_hashed_path_variable();
+    auto found = command_hash.find(name);
+    if(found != command_hash.end()){
+        if(count_hit) found->second.hits++;
+        return found->second.path;
+    }
+    string path = find_in_path(name);
+    if(!path.empty()) command_hash[name] = HashEntry{path, count_hit ? 1 : 0};
+    return path;
+}
+
+// ---------------- builtins ----------------
+// Run inside the shell without fork/exec (cd and export only make sense there anyway).
+// A builtin returns its exit status; to add one, write the function and put it in builtin_table.
+typedef int (*builtin_function)(const Program& program);
+static const unordered_map<string, builtin_function>& builtin_table();
+
+static int builtin_cd(const Program& program){
+    string dir;
+    if(program.args.empty()){
+        const char* home = getenv("HOME");
+        if(!home){
+            cerr << "[Error] cd: HOME not set\n";
+            return 1;
+        }
+        dir = home;
+    } else if(program.args[0] == "-"){
+        const char* old = getenv("OLDPWD");
+        if(!old){
+            cerr << "[Error] cd: OLDPWD not set\n";
+            return 1;
+        }
+        dir = old;
+        cout << dir << "\n";
+    } else {
+        dir = program.args[0];
+    }
+    char old_cwd[PATH_MAX];
+    bool has_old = getcwd(old_cwd, sizeof(old_cwd)) != nullptr;
+    if(chdir(dir.c_str()) < 0){
+        cerr << "[Error] cd: " << dir << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    if(has_old) setenv("OLDPWD", old_cwd, 1);
+    char cwd[PATH_MAX];
+    if(getcwd(cwd, sizeof(cwd))) setenv("PWD", cwd, 1);
+    return 0;
+}
+
+static int builtin_pwd(const Program&){
+    char cwd[PATH_MAX];
+    if(!getcwd(cwd, sizeof(cwd))){
+        cerr << "[Error] pwd: " << strerror(errno) << "\n";
+        return 1;
+    }
+    cout << cwd << "\n";
+    return 0;
+}
+
+static int builtin_exit(const Program& program){
+    cout << flush;
+    exit(program.args.empty() ? 0 : atoi(program.args[0].c_str()));
+}
+
+// export NAME=value ..., export NAME keeps an existing value, no argument lists the environment
+static int builtin_export(const Program& program){
+    if(program.args.empty()){
+        for(char** env = environ; *env; env++) cout << "export " << *env << "\n";
+        return 0;
+    }
+    int status = 0;
+    for(const string& arg: program.args){
+        size_t equal = arg.find('=');
+        string name = arg.substr(0, equal);
+        if(name.empty()){
+            cerr << "[Error] export: '" << arg << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        if(equal != string::npos) setenv(name.c_str(), arg.c_str() + equal + 1, 1);
+    }
+    return status;
+}
+
+static int builtin_unset(const Program& program){
+    for(const string& arg: program.args) unsetenv(arg.c_str());
+    return 0;
+}
+
+static int builtin_echo(const Program& program){
+    bool newline = true;
+    size_t i = 0;
+    if(!program.args.empty() && program.args[0] == "-n"){
+        newline = false;
+        i = 1;
+    }
+    for(; i < program.args.size(); i++){
+        cout << program.args[i];
+        if(i + 1 < program.args.size()) cout << " ";
+    }
+    if(newline) cout << "\n";
+    return 0;
+}
+
+static int builtin_true(const Program&){
+    return 0;
+}
+
+static int builtin_false(const Program&){
+    return 1;
+}
+
+static int builtin_type(const Program& program){
+    int status = 0;
+    for(const string& name: program.args){
+        if(builtin_table().count(name)){
+            cout << name << " is a shell builtin\n";
+            continue;
+        }
+        check_hashed_path_variable();
+        auto hashed = command_hash.find(name);
+        if(hashed != command_hash.end()){
+            cout << name << " is hashed (" << hashed->second.path << ")\n";
+            continue;
+        }
+        string path = find_in_path(name);
+        if(path.empty()){
+            cerr << "[Error] type: " << name << ": not found\n";
+            status = 1;
+            continue;
+        }
+        cout << name << " is " << path << "\n";
+    }
+    return status;
+}
+
+// hash: the table with hit counts, hash -r: forget everything, hash name...: look them up now
+static int builtin_hash(const Program& program){
+    check_hashed_path_variable();
+    if(program.args.empty()){
+        if(command_hash.empty()){
+            cout << "hash: hash table empty\n";
+            return 0;
+        }
+        vector<pair<string, HashEntry>> entries(command_hash.begin(), command_hash.end());
+        sort(entries.begin(), entries.end(), [](const pair<string, HashEntry>& a, const pair<string, HashEntry>& b){
+            return a.first < b.first;
+        });
+        cout << "hits\tcommand\n";
+        for(const auto& entry: entries){
+            cout << setw(4) << entry.second.hits << "\t" << entry.second.path << "\n";
+        }
+        return 0;
+    }
+    int status = 0;
+    for(const string& name: program.args){
+        if(name == "-r"){
+            command_hash.clear();
+            continue;
+        }
+        if(builtin_table().count(name)) continue; // like bash, builtins are not hashed
+        if(resolve_command(name, false).empty()){
+            cerr << "[Error] hash: " << name << ": not found\n";
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// finished jobs are listed once as Done, then forgotten
+static int builtin_jobs(const Program&){
+    vector<Job> running;
+    for(const Job& job: jobs){
+        bool done = waitpid(job.pid, nullptr, WNOHANG) != 0; // pid: just reaped, -1: reaped by sigchld_handler
+        cout << "[" << job.id << "] " << (done ? "Done   " : "Running") << "    " << job.command << "\n";
+        if(!done) running.push_back(job);
+    }
+    jobs.swap(running);
+    return 0;
+}
+
+static const unordered_map<string, builtin_function>& builtin_table(){
+    static const unordered_map<string, builtin_function> table = {
+        {"cd", builtin_cd},
+        {"pwd", builtin_pwd},
+        {"exit", builtin_exit},
+        {"export", builtin_export},
+        {"unset", builtin_unset},
+        {"echo", builtin_echo},
+        {"true", builtin_true},
+        {"false", builtin_false},
+        {"type", builtin_type},
+        {"jobs", builtin_jobs},
+        {"hash", builtin_hash},
+    };
+    return table;
+}
+
+static builtin_function find_builtin(const string& name){
+    auto found = builtin_table().find(name);
+    return found == builtin_table().end() ? nullptr : found->second;
+}
+
+// ---------------- launching ----------------
+// How a stage's stdin/stdout are set up is a list of file actions: the pipe ends dup2'd onto
+// 0 / 1 and closed, then the < / > files opened onto 0 / 1 (a redirection wins over the pipe).
+// Programs get the list as posix_spawn file actions: glibc spawns with clone(CLONE_VM |
+// CLONE_VFORK), the child never copies the shell's page tables, unlike fork. The < / > files are
+// opened by the shell first, so a missing file is reported as such and not as a failed spawn.
+// Builtins inside a
+// pipeline still fork (they are shell code) and apply the same list themselves, a builtin run
+// by the shell applies it around the call (run_builtin).
+struct FileAction{
+    enum Type{ OPEN, DUP2, CLOSE } type;
+    int fd;
+    int source_fd = -1; // DUP2: fd becomes a copy of it
+    string path; // OPEN
+    int flags = 0;
+    mode_t mode = 0;
+
+    FileAction(Type type, int fd): type(type), fd(fd){}
+};
+
+static FileAction dup2_action(int fd, int source_fd){
+    FileAction action(FileAction::DUP2, fd);
+    action.source_fd = source_fd;
+    return action;
+}
+
+static FileAction close_action(int fd){
+    return FileAction(FileAction::CLOSE, fd);
+}
+
+static FileAction open_action(int fd, const string& path, int flags, mode_t mode){
+    FileAction action(FileAction::OPEN, fd);
+    action.path = path;
+    action.flags = flags;
+    action.mode = mode;
+    return action;
+}
+
+// input_fd / output_fd: pipe ends for stdin / stdout (or STDIN_FILENO / STDOUT_FILENO),
+// unused_fd: the read end of the stage's own output pipe, only the next stage needs it (or -1)
+static vector<FileAction> stage_file_actions(const Program& program, int input_fd, int output_fd, int unused_fd){
+    vector<FileAction> actions;
+    if(input_fd != STDIN_FILENO){
+        actions.push_back(dup2_action(STDIN_FILENO, input_fd));
+        actions.push_back(close_action(input_fd));
+    }
+    if(output_fd != STDOUT_FILENO){
+        actions.push_back(dup2_action(STDOUT_FILENO, output_fd));
+        actions.push_back(close_action(output_fd));
+    }
+    if(unused_fd >= 0){
+        actions.push_back(close_action(unused_fd));
+    }
+    if(!program.infile.empty()){
+        actions.push_back(open_action(STDIN_FILENO, program.infile, O_RDONLY, 0));
+    }
+    if(!program.outfile.empty()){
+        actions.push_back(open_action(STDOUT_FILENO, program.outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    }
+    return actions;
+}
+
+// in this process: a forked builtin stage, or the shell itself around a builtin
+static bool apply_file_actions(const vector<FileAction>& actions){
+    for(const FileAction& action: actions){
+        if(action.type == FileAction::OPEN){
+            int file_descriptor = open(action.path.c_str(), action.flags, action.mode);
+            if(file_descriptor < 0){
+                cerr << "[Error] open " << action.path << " failed: " << strerror(errno) << "\n";
+                return false;
+            }
+            if(file_descriptor != action.fd){
+                int dup_status = dup2(file_descriptor, action.fd);
+                close(file_descriptor);
+                if(dup_status < 0){
+                    cerr << "[Error] duplicate " << action.path << " failed: " << strerror(errno) << "\n";
+                    return false;
+                }
+            }
+        }
+        else if(action.type == FileAction::DUP2){
+            if(dup2(action.source_fd, action.fd) < 0){
+                cerr << "[Error] duplicate pipe failed: " << strerror(errno) << "\n";
+                return false;
+            }
         }
+        else{
+            close(action.fd);
+        }
+    }
+    return true;
+}
+
+// the shell ignores SIGINT, children get the default back (an ignored signal stays ignored across exec)
+static posix_spawnattr_t* spawn_attributes(){
+    static posix_spawnattr_t attributes;
+    static bool initialized = false;
+    if(!initialized){
+        sigset_t default_signals;
+        sigemptyset(&default_signals);
+        sigaddset(&default_signals, SIGINT);
+        posix_spawnattr_init(&attributes);
+        posix_spawnattr_setsigdefault(&attributes, &default_signals);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF);
+        initialized = true;
+    }
+    return &attributes;
+}
+
+// start one stage, -1 if it could not be started (the error is printed)
+static pid_t launch_program(const Program& program, const vector<FileAction>& actions){
+    builtin_function builtin = find_builtin(program.program_name);
+    if(builtin){ // a pipeline stage is its own process anyway, the builtin runs in it
+        pid_t pid = fork();
+        if(pid < 0){
+            cerr << "[Error] fork failed: " << strerror(errno) << "\n";
+            return -1;
+        }
+        if(pid == 0){
+            signal(SIGINT, SIG_DFL);
+            if(!apply_file_actions(actions)) exit(1);
+            int status = builtin(program);
+            cout << flush;
+            exit(status);
+        }
+        return pid;
+    }
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    vector<int> opened; // redirection files, close-on-exec so only the dup2'd copy reaches the child
+    auto close_opened = [&](){
+        for(int file_descriptor: opened) close(file_descriptor);
+        posix_spawn_file_actions_destroy(&file_actions);
+    };
+    for(const FileAction& action: actions){
+        if(action.type == FileAction::OPEN){
+            int file_descriptor = open(action.path.c_str(), action.flags | O_CLOEXEC, action.mode);
+            if(file_descriptor < 0){
+                cerr << "[Error] open " << action.path << " failed: " << strerror(errno) << "\n";
+                close_opened();
+                return -1;
+            }
+            opened.push_back(file_descriptor);
+            posix_spawn_file_actions_adddup2(&file_actions, file_descriptor, action.fd);
+        }
+        else if(action.type == FileAction::DUP2){
+            posix_spawn_file_actions_adddup2(&file_actions, action.source_fd, action.fd);
+        }
+        else{
+            posix_spawn_file_actions_addclose(&file_actions, action.fd);
+        }
+    }
+    vector<char*> argv = args_to_argv(program);
+    pid_t pid;
+    auto spawn = [&](const string& path){
+        int status = posix_spawn(&pid, path.c_str(), &file_actions, spawn_attributes(), argv.data(), environ);
+        if(status == ENOEXEC){ // no #! line: run it as a shell script, like execvp does
+            vector<char*> script_argv = {const_cast<char*>("/bin/sh"), const_cast<char*>(path.c_str())};
+            script_argv.insert(script_argv.end(), argv.begin() + 1, argv.end());
+            status = posix_spawn(&pid, "/bin/sh", &file_actions, spawn_attributes(), script_argv.data(), environ);
+        }
+        return status;
+    };
+    // a failed exec is reported here by the child. ENOENT because a hashed file moved or went
+    // away since it was hashed: search PATH again once
+    string path = resolve_command(program.program_name, true);
+    int spawn_status = path.empty() ? ENOENT : spawn(path);
+    if(spawn_status == ENOENT && access(path.c_str(), F_OK) != 0 && command_hash.erase(program.program_name)){
+        path = resolve_command(program.program_name, true);
+        if(!path.empty()) spawn_status = spawn(path);
+    }
+    close_opened();
+    if(spawn_status != 0){
+        cerr << "[Error] spawn " << program.program_name << " failed: " << strerror(spawn_status) << "\n";
+        return -1;
+    }
+    return pid;
+}
+
+// a single command that is a builtin runs right here, its redirections are undone afterwards
+static int run_builtin(const Program& program, builtin_function function){
+    bool redirected = !program.infile.empty() || !program.outfile.empty();
+    int saved_stdin = -1, saved_stdout = -1;
+    if(redirected){
+        saved_stdin = dup(STDIN_FILENO);
+        saved_stdout = dup(STDOUT_FILENO);
+    }
+    int status = 1;
+    if(!redirected || apply_file_actions(stage_file_actions(program, STDIN_FILENO, STDOUT_FILENO, -1))){
+        status = function(program);
+    }
+    cout << flush; // before stdout goes back to the terminal
+    if(redirected){
+        dup2(saved_stdin, STDIN_FILENO);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdin);
+        close(saved_stdout);
+    }
+    return status;
+}
+
+static void run_program(Program program){
+    if(program.program_name.empty()) return;
+    pid_t pid = launch_program(program, stage_file_actions(program, STDIN_FILENO, STDOUT_FILENO, -1));
+    if(pid < 0) return;
+    if(!program.background){ // wait for child process
+        waitpid(pid, nullptr, 0);
+    } else {
+        add_job(pid, program); // no need to do any waiting
     }
 }
 
@@ -183,58 +613,41 @@ static void run_pipeline_programs(vector<Program> programs){
     // 1: input of pipe, 0: output of pipe => progA -> 1-pipe-0 -> progB
     vector<pid_t> pids;
 
-    
     for(int i=0;i<program_num;i++){
         Program program = programs[i];
+        int output_file_descriptor = STDOUT_FILENO;
+        int unused_file_descriptor = -1;
 
         if(i <= program_num - 2){ // not last program => no need to deal with pipeline
             int pipe_status = pipe(pipe_file_descriptors); // create a pipe after this program
             if(pipe_status < 0){
-                cerr << "[Error] create pipe failed: " << "\n";
+                cerr << "[Error] create pipe failed: " << strerror(errno) << "\n";
+                break; // the stages started so far still get waited for
             }
+            output_file_descriptor = pipe_file_descriptors[1];
+            unused_file_descriptor = pipe_file_descriptors[0]; // the child only writes into this pipe
         }
 
-        pid_t pid = fork(); // forked process starts from here
-        if(pid < 0) {
-            cerr << ("[Error] Fork Failed");
-            exit(-1); // not standard error
-        }
-        if(pid == 0){ // child process, exeute the program
-            signal(SIGINT, SIG_DFL);
-            if(input_file_descriptor != STDIN_FILENO){
-                dup2(input_file_descriptor, STDIN_FILENO);
-                close(input_file_descriptor); // close the pipe (pipe end when input, output end)
-            }
-            if(i <= program_num - 2){
-                dup2(pipe_file_descriptors[1], STDOUT_FILENO);
-                close(pipe_file_descriptors[1]);
-                close(pipe_file_descriptors[0]); // child process will copy a pipe and its pointer => close child process' pipe output pointer
-            }
-
-            redirect_handler(program);
-            vector<char*> argv = args_to_argv(program);
-            int execvp_status = execvp(program.program_name.c_str(), argv.data()); // replace current process with excuted program
-            if(execvp_status < 0){
-                cerr << "[Error] execvp failed: " << "\n";
-            }
-            exit(127);
-        } else { // parent process, pid is child process' id
+        pid_t pid = launch_program(program, stage_file_actions(program, input_file_descriptor, output_file_descriptor, unused_file_descriptor));
 
-            if(input_file_descriptor != STDIN_FILENO){
-                close(input_file_descriptor); // pervious pipe's output space pointer
-            }
-            if (i <= program_num - 2) {
-                close(pipe_file_descriptors[1]);
-                input_file_descriptor = pipe_file_descriptors[0];
-            }
+        if(input_file_descriptor != STDIN_FILENO){
+            close(input_file_descriptor); // pervious pipe's output space pointer
+        }
+        if (i <= program_num - 2) {
+            close(pipe_file_descriptors[1]);
+            input_file_descriptor = pipe_file_descriptors[0];
+        }
 
-            if(!program.background){ // wait for child process
-                pids.push_back(pid);
-            } else {
-                // no need to do any waiting
-            }
+        if(pid < 0) continue; // the next stage reads EOF
+        if(!program.background){ // wait for child process
+            pids.push_back(pid);
+        } else {
+            add_job(pid, program); // no need to do any waiting
         }
     }
+    if(input_file_descriptor != STDIN_FILENO){ // left over when a pipe could not be created
+        close(input_file_descriptor);
+    }
     for (pid_t pid : pids) { // wait for all child, for better parallelism
         waitpid(pid, nullptr, 0);
     }
@@ -273,7 +686,13 @@ signed main(){
         if(parser.programs.empty()) continue;
 
         if(!parser.is_pipeline){
-            run_program(parser.programs[0]);
+            builtin_function builtin = find_builtin(parser.programs[0].program_name);
+            if(builtin){ // no fork, '&' makes no difference
+                run_builtin(parser.programs[0], builtin);
+            }
+            else{
+                run_program(parser.programs[0]);
+            }
         }
         else{
             run_pipeline_programs(parser.programs);
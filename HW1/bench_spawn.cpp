@@ -0,0 +1,111 @@
+// Spawn latency benchmark: start a program and wait for it, n times each with fork + execv,
+// vfork + execv and posix_spawn (what the shell uses), and report latency percentiles.
+// -m makes the process as big as a long-running shell could get: fork copies the page tables
+// of every touched page, vfork / posix_spawn share the parent's memory until exec.
+// usage: ./bench_spawn.out [-n runs] [-m heap_mb] [program]
+#include <bits/stdc++.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <spawn.h>
+using namespace std;
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static pid_t launch_fork(char* const argv[]){
+    pid_t pid = fork();
+    if(pid == 0){
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launch_vfork(char* const argv[]){
+    pid_t pid = vfork();
+    if(pid == 0){ // shares our memory until execv, nothing but exec / _exit here
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launch_posix_spawn(char* const argv[]){
+    pid_t pid;
+    if(posix_spawn(&pid, argv[0], nullptr, nullptr, argv, environ) != 0) return -1;
+    return pid;
+}
+
+static uint64_t percentile(const vector<uint64_t>& sorted, double p){
+    if(sorted.empty()) return 0;
+    return sorted[(size_t)(p / 100.0 * (sorted.size() - 1) + 0.5)];
+}
+
+static void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-n runs] [-m heap_mb] [program]\n";
+    cerr << "  -n  launches per method (default 1000)\n";
+    cerr << "  -m  touch this many MiB first, a big parent makes fork slower (default 0)\n";
+    cerr << "  program: absolute path of what to run (default /bin/true)\n";
+}
+
+int main(int argc, char* argv[]){
+    int runs = 1000;
+    size_t heap_mb = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "n:m:h")) != -1){
+        if(opt == 'n') runs = max(1, atoi(optarg));
+        else if(opt == 'm') heap_mb = atol(optarg);
+        else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    string program = optind < argc ? argv[optind] : "/bin/true";
+    if(program[0] != '/' || access(program.c_str(), X_OK) != 0){
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<char> heap(heap_mb * 1024 * 1024);
+    for(size_t i = 0; i < heap.size(); i += 4096) heap[i] = (char)i; // really mapped, not just reserved
+
+    char* child_argv[] = {const_cast<char*>(program.c_str()), nullptr};
+    const pair<const char*, pid_t (*)(char* const[])> methods[] = {
+        {"fork+exec", launch_fork},
+        {"vfork+exec", launch_vfork},
+        {"posix_spawn", launch_posix_spawn},
+    };
+
+    cout << "Program: " << program << ", " << runs << " runs per method, " << heap_mb << " MiB touched\n";
+    cout << "Latency (us)\tp50\tp90\tp99\tmean\tspawns/sec\n";
+    for(const auto& method: methods){
+        vector<uint64_t> latency;
+        latency.reserve(runs);
+        uint64_t total = 0;
+        for(int i = 0; i < runs; i++){
+            uint64_t start = now_ns();
+            pid_t pid = method.second(child_argv);
+            if(pid < 0){
+                cerr << "[Error] " << method.first << " failed: " << strerror(errno) << "\n";
+                return 1;
+            }
+            waitpid(pid, nullptr, 0);
+            uint64_t ns = now_ns() - start;
+            latency.push_back(ns);
+            total += ns;
+        }
+        sort(latency.begin(), latency.end());
+        printf("%-12s\t%.1f\t%.1f\t%.1f\t%.1f\t%.0f\n", method.first,
+               percentile(latency, 50) / 1e3, percentile(latency, 90) / 1e3, percentile(latency, 99) / 1e3,
+               total / 1e3 / runs, runs / (total / 1e9));
+    }
+    return 0;
+}
+/*
+g++ -O2 bench_spawn.cpp -o bench_spawn.out
+./bench_spawn.sh (0, 256 and 1024 MiB parents)
+*/
@@ -0,0 +1,13 @@
+#! /bin/bash
+# Compare fork + exec, vfork + exec and posix_spawn latency as the parent process grows.
+# usage: ./bench_spawn.sh [runs] [program]
+
+RUNS=${1:-1000}
+PROGRAM=${2:-/bin/true}
+
+g++ -O2 bench_spawn.cpp -o bench_spawn.out || exit 1
+
+for HEAP_MB in 0 256 1024; do
+  echo "[1;34m===== ${HEAP_MB} MiB parent =====[m"
+  ./bench_spawn.out -n ${RUNS} -m ${HEAP_MB} ${PROGRAM}
+done
@@ -0,0 +1,299 @@
+// Allocation trace replay benchmark.
+// Replays a main.c style trace ("A\t<id>\t<size>" / "D\t<id>") and reports
+// throughput, latency percentiles, peak RSS and fragmentation.
+// Link with hw4_112550069.c to measure the multilevel best-fit allocator,
+// or build it alone to get the glibc baseline (see bench.sh).
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OP_ALLOC 0
+#define OP_FREE 1
+
+typedef struct TraceOp {
+    uint32_t type;
+    uint32_t id;
+    size_t size;
+} TraceOp;
+
+// only the multilevel best-fit allocator exports this, glibc leaves it NULL
+extern void mlbf_free_stats(size_t *total_free, size_t *largest_free) __attribute__((weak));
+
+// the allocator under test may have a tiny pool, so the harness never uses malloc itself
+static void *map_array(size_t bytes) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    void *addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        perror("[Error] mmap failed");
+        exit(1);
+    }
+    return addr;
+}
+
+__attribute__((format(printf, 1, 2)))
+static void print_line(const char *fmt, ...) {
+    char buffer[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(buffer) - 1) {
+        len = sizeof(buffer) - 1;
+    }
+    write(STDOUT_FILENO, buffer, len);
+}
+
+static const char *skip_blank(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static const char *parse_number(const char *p, const char *end, size_t *value) {
+    size_t v = 0;
+    p = skip_blank(p, end);
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    *value = v;
+    return p;
+}
+
+// parse the whole mmapped trace up front so parsing is never timed
+static TraceOp *load_trace(const char *filename, size_t *op_count, size_t *max_id) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("[Error] open trace failed");
+        exit(1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size == 0) {
+        *op_count = 0;
+        *max_id = 0;
+        close(fd);
+        return NULL;
+    }
+    const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) {
+        perror("[Error] mmap trace failed");
+        exit(1);
+    }
+    close(fd);
+    const char *end = text + st.st_size;
+
+    size_t lines = 1;
+    for (const char *p = text; p < end; p++) {
+        if (*p == '\n') lines++;
+    }
+    TraceOp *ops = map_array(lines * sizeof(TraceOp));
+
+    size_t n = 0;
+    *max_id = 0;
+    const char *p = text;
+    while (p < end) {
+        const char *line_end = memchr(p, '\n', end - p);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        p = skip_blank(p, line_end);
+        if (p < line_end && (*p == 'A' || *p == 'D')) {
+            size_t id, size = 0;
+            ops[n].type = (*p == 'A') ? OP_ALLOC : OP_FREE;
+            p = parse_number(p + 1, line_end, &id);
+            if (ops[n].type == OP_ALLOC) {
+                parse_number(p, line_end, &size);
+            }
+            ops[n].id = id;
+            ops[n].size = size;
+            if (id > *max_id) *max_id = id;
+            n++;
+        }
+        p = line_end + 1;
+    }
+    munmap((void *)text, st.st_size);
+    *op_count = n;
+    return ops;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sift_down(uint64_t *a, size_t root, size_t n) {
+    while (2 * root + 1 < n) {
+        size_t child = 2 * root + 1;
+        if (child + 1 < n && a[child + 1] > a[child]) child++;
+        if (a[root] >= a[child]) return;
+        uint64_t tmp = a[root];
+        a[root] = a[child];
+        a[child] = tmp;
+        root = child;
+    }
+}
+
+// in-place heap sort, qsort may call malloc on large arrays
+static void sort_latency(uint64_t *a, size_t n) {
+    for (size_t i = n / 2; i-- > 0;) {
+        sift_down(a, i, n);
+    }
+    for (size_t i = n; i-- > 1;) {
+        uint64_t tmp = a[0];
+        a[0] = a[i];
+        a[i] = tmp;
+        sift_down(a, 0, i);
+    }
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t idx = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void usage(const char *prog) {
+    print_line("Usage: %s [-c] [-n] <trace_file>\n", prog);
+    print_line("  -c  print one csv line (for regression logs)\n");
+    print_line("  -n  do not touch allocated memory between operations\n");
+}
+
+int main(int argc, char *argv[]) {
+    int csv = 0, touch = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "cnh")) != -1) {
+        if (opt == 'c') csv = 1;
+        else if (opt == 'n') touch = 0;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *allocator = mlbf_free_stats ? "multilevelBF" : "glibc";
+
+    size_t op_count, max_id;
+    TraceOp *ops = load_trace(argv[optind], &op_count, &max_id);
+    char **ptr = map_array((max_id + 1) * sizeof(char *));
+    size_t *requested = map_array((max_id + 1) * sizeof(size_t));
+    uint64_t *alloc_latency = map_array(op_count * sizeof(uint64_t));
+    uint64_t *free_latency = map_array(op_count * sizeof(uint64_t));
+    size_t alloc_n = 0, free_n = 0, failed = 0;
+    size_t live_requested = 0, live_usable = 0;
+    size_t peak_requested = 0, peak_usable = 0;
+    uint64_t total_ns = 0;
+
+    for (size_t i = 0; i < op_count; i++) {
+        TraceOp op = ops[i];
+        if (op.type == OP_ALLOC) {
+            size_t size = op.size ? op.size : 1; // malloc(0) is the report hook of HW4
+            uint64_t t0 = now_ns();
+            char *p = malloc(size);
+            uint64_t t1 = now_ns();
+            alloc_latency[alloc_n++] = t1 - t0;
+            total_ns += t1 - t0;
+            if (p == NULL) {
+                failed++;
+                continue;
+            }
+            // an id reused without free leaks the old block like main.c, it stays counted as live
+            ptr[op.id] = p;
+            requested[op.id] = size;
+            live_requested += size;
+            live_usable += malloc_usable_size(p);
+            if (live_usable > peak_usable) {
+                peak_usable = live_usable;
+                peak_requested = live_requested;
+            }
+            if (touch) {
+                memset(p, (int)i, size);
+            }
+        } else {
+            char *p = ptr[op.id];
+            if (p == NULL) {
+                continue; // freeing a failed allocation
+            }
+            size_t usable = malloc_usable_size(p);
+            uint64_t t0 = now_ns();
+            free(p);
+            uint64_t t1 = now_ns();
+            free_latency[free_n++] = t1 - t0;
+            total_ns += t1 - t0;
+            ptr[op.id] = NULL;
+            live_requested -= requested[op.id];
+            live_usable -= usable;
+        }
+    }
+
+    size_t total_free = 0, largest_free = 0;
+    if (mlbf_free_stats) {
+        mlbf_free_stats(&total_free, &largest_free);
+    }
+    struct rusage usage_info;
+    getrusage(RUSAGE_SELF, &usage_info);
+
+    sort_latency(alloc_latency, alloc_n);
+    sort_latency(free_latency, free_n);
+    size_t timed_ops = alloc_n + free_n;
+    double ops_per_sec = total_ns ? timed_ops / (total_ns / 1e9) : 0.0;
+    double internal_waste = peak_usable ? 1.0 - (double)peak_requested / peak_usable : 0.0;
+    double external_frag = total_free ? 1.0 - (double)largest_free / total_free : 0.0;
+
+    if (csv) {
+        // allocator,ops,failed,ops_per_sec,malloc_p50,malloc_p99,free_p50,free_p99,peak_rss_kb,internal_waste,external_frag
+        print_line("%s,%zu,%zu,%.0f,%lu,%lu,%lu,%lu,%ld,%.6f,",
+                   allocator, timed_ops, failed, ops_per_sec,
+                   (unsigned long)percentile(alloc_latency, alloc_n, 50),
+                   (unsigned long)percentile(alloc_latency, alloc_n, 99),
+                   (unsigned long)percentile(free_latency, free_n, 50),
+                   (unsigned long)percentile(free_latency, free_n, 99),
+                   usage_info.ru_maxrss, internal_waste);
+        if (mlbf_free_stats) print_line("%.6f\n", external_frag);
+        else print_line("\n");
+        return 0;
+    }
+
+    print_line("Allocator: %s\n", allocator);
+    print_line("Operations: %zu (malloc %zu, free %zu, failed malloc %zu)\n", timed_ops, alloc_n, free_n, failed);
+    print_line("Time in malloc/free: %.6f sec, %.0f ops/sec\n", total_ns / 1e9, ops_per_sec);
+    print_line("Latency (ns)\tp50\tp90\tp99\tp99.9\tmax\n");
+    print_line("malloc\t\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+               (unsigned long)percentile(alloc_latency, alloc_n, 50),
+               (unsigned long)percentile(alloc_latency, alloc_n, 90),
+               (unsigned long)percentile(alloc_latency, alloc_n, 99),
+               (unsigned long)percentile(alloc_latency, alloc_n, 99.9),
+               (unsigned long)(alloc_n ? alloc_latency[alloc_n - 1] : 0));
+    print_line("free\t\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+               (unsigned long)percentile(free_latency, free_n, 50),
+               (unsigned long)percentile(free_latency, free_n, 90),
+               (unsigned long)percentile(free_latency, free_n, 99),
+               (unsigned long)percentile(free_latency, free_n, 99.9),
+               (unsigned long)(free_n ? free_latency[free_n - 1] : 0));
+    print_line("Peak RSS: %ld KB\n", usage_info.ru_maxrss);
+    print_line("Internal waste at peak: %.4f (requested %zu / usable %zu bytes)\n",
+               internal_waste, peak_requested, peak_usable);
+    if (mlbf_free_stats) {
+        print_line("External fragmentation: %.4f (largest free %zu / total free %zu bytes)\n",
+                   external_frag, largest_free, total_free);
+    } else {
+        print_line("External fragmentation: n/a (allocator does not expose its free lists)\n");
+    }
+    return 0;
+}
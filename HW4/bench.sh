@@ -0,0 +1,14 @@
+#! /bin/bash
+# Replay the same allocation trace against the multilevel best-fit allocator and glibc.
+# usage: ./bench.sh <trace_file> [-c]
+
+TRACE=${1:-test3.txt}
+shift
+
+gcc -O2 bench.c hw4_112550069.c -o bench_mlbf.out || exit 1
+gcc -O2 bench.c -o bench_glibc.out || exit 1
+
+echo "[1;34m===== multilevel best fit =====[m"
+./bench_mlbf.out "$@" ${TRACE}
+echo "[1;34m===== glibc baseline =====[m"
+./bench_glibc.out "$@" ${TRACE}
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stddef.h>
+#include <errno.h>
+#include <stdint.h>
 #define POOL_SIZE 20000
 #define HEADER_SIZE 32
 #define NUM_LEVELS 11
@@ -19,6 +21,8 @@ typedef struct ChunkHeader {
 
 void *pool_start = NULL;
 ChunkHeader *free_lists[NUM_LEVELS]; // 用metadata來當作linklist內容維護
+// everything at or above this address has never been written since mmap, so it is still zero
+static char *pool_high_water = NULL;
 
 static int compute_level(size_t size) {
     size_t size_levels = size / ALLOC_SIZE_UNIT; // 32
@@ -84,10 +88,42 @@ static void init_pool() {
 
     ChunkHeader *initial_chunk = (ChunkHeader *)pool_start; // init chunk的位置 == pool_start拿到的位置
     initial_chunk->chunk_size = POOL_SIZE - HEADER_SIZE;
+    pool_high_water = (char *)pool_start + HEADER_SIZE;
 
     add_to_free_list(initial_chunk);
 }
 
+static void touch_pool(char *end) {
+    if (end > pool_high_water) {
+        pool_high_water = end;
+    }
+}
+
+// split the tail of an in-use chunk into a new free chunk if it is big enough
+static void split_chunk(ChunkHeader *chunk, size_t size) {
+    size_t remaining_size = chunk->chunk_size - size;
+    if (remaining_size < HEADER_SIZE + ALLOC_SIZE_UNIT) { // too small, keep it as internal waste
+        return;
+    }
+    ChunkHeader *splited_chunk = (ChunkHeader *)((char *)chunk + HEADER_SIZE + size); // 1. to 1 byte unit 2. offset to next chunk's position
+    splited_chunk->chunk_size = remaining_size - HEADER_SIZE;
+    chunk->chunk_size = size;
+    touch_pool((char *)splited_chunk + HEADER_SIZE);
+
+    // the old neighbour may be free (realloc shrink), keep free chunks coalesced
+    ChunkHeader *next_chunk_in_mem = (ChunkHeader *)((char *)splited_chunk + HEADER_SIZE + splited_chunk->chunk_size);
+    if ((char *)next_chunk_in_mem < (char *)pool_start + POOL_SIZE && next_chunk_in_mem->is_free) {
+        remove_from_free_list(next_chunk_in_mem);
+        splited_chunk->chunk_size += HEADER_SIZE + next_chunk_in_mem->chunk_size;
+    }
+    add_to_free_list(splited_chunk);
+}
+
+// nothing bigger than the pool can ever fit, reject it before rounding up can overflow
+static int too_big(size_t size) {
+    return size > POOL_SIZE - HEADER_SIZE;
+}
+
 static size_t round_up_32(size_t size) {
     if (size == 0) {
         return ALLOC_SIZE_UNIT; // 即使請求 0, 至少也分配 32
@@ -112,39 +148,17 @@ static ChunkHeader *find_the_biggest_free_chunk(){
     return biggest_chunk;
 }
 
-void *malloc(size_t size){
-
+// best fit search + split, shared by malloc and the other libc entry points
+static void *allocate_chunk(size_t size) {
     if (pool_start == NULL) {
         init_pool();
     }
 
-    if( size == 0) {
-        ChunkHeader *biggest_chunk = find_the_biggest_free_chunk();
-        char buffer[128];
-        sprintf(buffer, "Max Free Chunk Size = %zu\n", biggest_chunk->chunk_size);
-        write(STDOUT_FILENO, buffer, strlen(buffer));
-        munmap(pool_start, POOL_SIZE);
-        pool_start = NULL;
-        return NULL;
-    }
-
-    if (size == -1){ // for debug
-        ChunkHeader *biggest_chunk = find_the_biggest_free_chunk();
-        char buffer[128];
-        if(biggest_chunk == NULL){
-            sprintf(buffer, "[DEBUG] No Free Chunk Available\n");
-            write(STDOUT_FILENO, buffer, strlen(buffer));
-        }
-        else{
-            sprintf(buffer, "[DEBUG] Max Free Chunk Size = %zu\n", biggest_chunk->chunk_size);
-            write(STDOUT_FILENO, buffer, strlen(buffer));
-        }
+    if (too_big(size)) {
         return NULL;
     }
-
     size = round_up_32(size);
     int level = compute_level(size);
-    ChunkHeader *level_start;
     ChunkHeader *best_fit_chunk = NULL;
     for(int i = level; i < NUM_LEVELS; i++){
         ChunkHeader *level_start = free_lists[i];
@@ -164,19 +178,57 @@ void *malloc(size_t size){
         return NULL; // no any enough chunk
     }
     remove_from_free_list(best_fit_chunk);
-    size_t remaining_size = best_fit_chunk->chunk_size - size;
+    split_chunk(best_fit_chunk, size);
+    // a remainder too small to split stays in the chunk and is usable (malloc_usable_size)
+    touch_pool((char *)best_fit_chunk + HEADER_SIZE + best_fit_chunk->chunk_size);
+
+    return (char *)best_fit_chunk + HEADER_SIZE; // where the data section start
+}
+
 
-    if (remaining_size >= HEADER_SIZE + ALLOC_SIZE_UNIT) { // can be split
-        ChunkHeader *splited_chunk = (ChunkHeader *)((char *)best_fit_chunk + HEADER_SIZE + size); // 1. to 1 byte unit 2. offset to next chunk's position
-        splited_chunk->chunk_size = remaining_size - HEADER_SIZE;
-        add_to_free_list(splited_chunk);
-        best_fit_chunk->chunk_size = size;
+// malloc(0) is the report hook of the assignment (print the largest free chunk, unmap the
+// pool) and the pool is a fixed POOL_SIZE with no lock, so the full libc surface below is for
+// programs built against it (main.c, bench.c), not for LD_PRELOAD into arbitrary binaries.
+// A request that does not fit fails with ENOMEM, there is no fallback to the system allocator.
+void *malloc(size_t size){
+
+    if (pool_start == NULL) {
+        init_pool();
     }
 
-    return (char *)best_fit_chunk + HEADER_SIZE; // where the data section start
+    if( size == 0) {
+        ChunkHeader *biggest_chunk = find_the_biggest_free_chunk();
+        char buffer[128];
+        sprintf(buffer, "Max Free Chunk Size = %zu\n", biggest_chunk->chunk_size);
+        write(STDOUT_FILENO, buffer, strlen(buffer));
+        munmap(pool_start, POOL_SIZE);
+        pool_start = NULL;
+        return NULL;
+    }
+
+    if (size == -1){ // for debug
+        ChunkHeader *biggest_chunk = find_the_biggest_free_chunk();
+        char buffer[128];
+        if(biggest_chunk == NULL){
+            sprintf(buffer, "[DEBUG] No Free Chunk Available\n");
+            write(STDOUT_FILENO, buffer, strlen(buffer));
+        }
+        else{
+            sprintf(buffer, "[DEBUG] Max Free Chunk Size = %zu\n", biggest_chunk->chunk_size);
+            write(STDOUT_FILENO, buffer, strlen(buffer));
+        }
+        return NULL;
+    }
+
+    void *ptr = allocate_chunk(size);
+    if (ptr == NULL) errno = ENOMEM;
+    return ptr;
 }
 
 void free(void *ptr){
+    if (ptr == NULL) {
+        return;
+    }
     // user get data section position, offset to chunk position
     ChunkHeader *chunk_to_free = (ChunkHeader *)((char *)ptr - HEADER_SIZE);
     ChunkHeader *next_chunk_in_mem = (ChunkHeader *)((char *)ptr + chunk_to_free->chunk_size);
@@ -211,4 +263,164 @@ void free(void *ptr){
         merged_chunk->chunk_size += HEADER_SIZE + chunk_to_free->chunk_size;
     }
     add_to_free_list(merged_chunk);
-}
\ No newline at end of file
+}
+
+void *calloc(size_t nmemb, size_t size){
+    if (size != 0 && nmemb > SIZE_MAX / size) { // nmemb * size overflow
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (pool_start == NULL) {
+        init_pool();
+    }
+    size_t total = nmemb * size;
+    char *clean_from = pool_high_water; // the part above it is fresh mmap memory, already zero
+    char *ptr = allocate_chunk(total);
+    if (ptr == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (ptr < clean_from) {
+        size_t dirty = (size_t)(clean_from - ptr);
+        memset(ptr, 0, dirty < total ? dirty : total);
+    }
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size){
+    if (ptr == NULL) {
+        void *new_ptr = allocate_chunk(size);
+        if (new_ptr == NULL) errno = ENOMEM;
+        return new_ptr;
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    if (too_big(size)) { // old block is left untouched
+        errno = ENOMEM;
+        return NULL;
+    }
+    ChunkHeader *chunk = (ChunkHeader *)((char *)ptr - HEADER_SIZE);
+    size = round_up_32(size);
+
+    if (size <= chunk->chunk_size) { // shrink in place, give the tail back to the pool
+        split_chunk(chunk, size);
+        return ptr;
+    }
+
+    // grow in place by absorbing the next chunk if it is free and large enough
+    ChunkHeader *next_chunk_in_mem = (ChunkHeader *)((char *)ptr + chunk->chunk_size);
+    if ((char *)next_chunk_in_mem < (char *)pool_start + POOL_SIZE && next_chunk_in_mem->is_free &&
+        chunk->chunk_size + HEADER_SIZE + next_chunk_in_mem->chunk_size >= size) {
+        remove_from_free_list(next_chunk_in_mem);
+        chunk->chunk_size += HEADER_SIZE + next_chunk_in_mem->chunk_size;
+        split_chunk(chunk, size);
+        touch_pool((char *)ptr + chunk->chunk_size);
+        return ptr;
+    }
+
+    // move to a new chunk
+    char *new_ptr = allocate_chunk(size);
+    if (new_ptr == NULL) { // old block is left untouched
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, chunk->chunk_size);
+    free(ptr);
+    return new_ptr;
+}
+
+// every data section is already 32 bytes aligned, larger alignment is done by
+// over-allocating and giving the leading gap back as a free chunk
+static void *allocate_aligned(size_t alignment, size_t size) {
+    if (alignment <= ALLOC_SIZE_UNIT) {
+        return allocate_chunk(size);
+    }
+    if (too_big(size) || too_big(alignment)) { // size + 2 * alignment cannot overflow after this
+        return NULL;
+    }
+    size = round_up_32(size);
+    char *ptr = allocate_chunk(size + 2 * alignment); // enough for a gap of at least one chunk
+    if (ptr == NULL) {
+        return NULL;
+    }
+
+    char *aligned = (char *)(((uintptr_t)ptr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (aligned != ptr && (size_t)(aligned - ptr) < HEADER_SIZE + ALLOC_SIZE_UNIT) {
+        aligned += alignment; // gap is too small to become a chunk
+    }
+    if (aligned == ptr) {
+        split_chunk((ChunkHeader *)(ptr - HEADER_SIZE), size);
+        return ptr;
+    }
+
+    // [ptr - HEADER, aligned - HEADER) becomes a free chunk, its previous neighbour is in use
+    ChunkHeader *gap_chunk = (ChunkHeader *)(ptr - HEADER_SIZE);
+    ChunkHeader *aligned_chunk = (ChunkHeader *)(aligned - HEADER_SIZE);
+    size_t gap = (size_t)(aligned - ptr);
+    aligned_chunk->chunk_size = gap_chunk->chunk_size - gap;
+    aligned_chunk->is_free = 0;
+    aligned_chunk->next_chunk = NULL;
+    aligned_chunk->prev_chunk = NULL;
+    gap_chunk->chunk_size = gap - HEADER_SIZE;
+    add_to_free_list(gap_chunk);
+
+    split_chunk(aligned_chunk, size);
+    return aligned;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size){
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void *) != 0) {
+        return EINVAL;
+    }
+    void *ptr = allocate_aligned(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *memalign(size_t alignment, size_t size){
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *ptr = allocate_aligned(alignment, size);
+    if (ptr == NULL) errno = ENOMEM;
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size){
+    return memalign(getpagesize(), size);
+}
+
+size_t malloc_usable_size(void *ptr){
+    if (ptr == NULL) {
+        return 0;
+    }
+    return ((ChunkHeader *)((char *)ptr - HEADER_SIZE))->chunk_size;
+}
+
+// used by bench.c to report external fragmentation
+void mlbf_free_stats(size_t *total_free, size_t *largest_free){
+    *total_free = 0;
+    *largest_free = 0;
+    if (pool_start == NULL) {
+        return;
+    }
+    for (int i = 0; i < NUM_LEVELS; i++) {
+        for (ChunkHeader *current = free_lists[i]; current != NULL; current = current->next_chunk) {
+            *total_free += current->chunk_size;
+            if (current->chunk_size > *largest_free) {
+                *largest_free = current->chunk_size;
+            }
+        }
+    }
+}
@@ -6,6 +6,17 @@
 #include <cmath>
 #include <cstring>
 #include <iomanip>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <sstream>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 using namespace std;
 
 #define HASH_TABLE_RATIO 2.0
@@ -31,6 +42,11 @@ public:
         gettimeofday(&end_time, NULL);
         return elapsed_sec();
     }
+    double peek() const { // elapsed time without stopping, safe to call from many threads
+        timeval now;
+        gettimeofday(&now, NULL);
+        return (now.tv_sec - start_time.tv_sec) + (now.tv_usec - start_time.tv_usec) / 1e6;
+    }
     void clear(){
         memset(&start_time, 0, sizeof(start_time));
         memset(&end_time, 0, sizeof(end_time));
@@ -39,370 +55,1807 @@ public:
 
 vector<TraceItem> traces;
 
-class PageMeta { // page link list
-public:
-    PageMeta *prev;
-    PageMeta *next;
+struct SimResult {
+    int frames;
+    long long hit;
+    long long miss;
+    long long write_back;
+    double finish_sec = 0; // wall time from the start of the sweep until this configuration is done
+};
+
+void print_result(const SimResult& result){
+    printf("%d\t%lld\t%lld\t\t%.10f\t\t%lld\n", 
+           result.frames, result.hit, result.miss, (double)result.miss / (result.hit + result.miss), result.write_back);
+}
+
+#define NIL_INDEX 0xffffffffu // end of list, index links are 32 bits instead of pointers
+
+// state: bit 0~2 primary list id, bit 3~4 aux list id (0 means not in a list)
+#define LIST_MASK 0x7
+#define AUX_LIST_SHIFT 3
+#define AUX_LIST_MASK (0x3 << AUX_LIST_SHIFT)
+// flags
+#define DIRTY_BIT 0x1
+#define RESIDENT_BIT 0x2 // page data is in a frame, otherwise only history (ghost) is kept
+#define REF_BIT 0x4 // CLOCK family reference bit
+#define HOT_BIT 0x8 // LIRS: LIR page, CLOCK-Pro: hot page
+#define TEST_BIT 0x10 // CLOCK-Pro: cold page in its test period
+
+struct alignas(32) PageMeta { // page link list, 32 bytes => never straddles a cache line
     unsigned long long page_number;
-    bool dirty;
-    string list_type = "NONE"; // NONE, WORKING, CLEAN, DIRTY
-    // for hash table if collision => linklist in the bucket
-    PageMeta *hash_next; 
+    uint32_t prev; // index in node_pool
+    uint32_t next;
+    // chained table: next node in the bucket (collision => linklist), Swiss table: slot of this node
+    uint32_t hash_link;
+    uint32_t aux_prev; // a second list membership (LIRS queue / ghost FIFO)
+    uint32_t aux_next;
+    uint8_t state;
+    uint8_t flags;
+    inline bool has(uint8_t bit) const { return flags & bit; }
+    inline void set(uint8_t bit) { flags |= bit; }
+    inline void clear(uint8_t bit) { flags &= ~bit; }
+    inline bool dirty() const { return has(DIRTY_BIT); }
+    inline bool resident() const { return has(RESIDENT_BIT); }
+    inline int list_type() const { return state & LIST_MASK; }
+    inline void set_list_type(int type) { state = (state & ~LIST_MASK) | type; }
+    inline int aux_list_type() const { return (state & AUX_LIST_MASK) >> AUX_LIST_SHIFT; }
+    inline void set_aux_list_type(int type) { state = (state & ~AUX_LIST_MASK) | (type << AUX_LIST_SHIFT); }
     void initialize(unsigned long long page_number, bool dirty = false){
         this->page_number = page_number;
-        this->dirty = dirty;
-        this->prev = nullptr;
-        this->next = nullptr;
-        this->hash_next = nullptr;
+        this->state = 0;
+        this->flags = RESIDENT_BIT | (dirty ? DIRTY_BIT : 0);
+        this->prev = NIL_INDEX;
+        this->next = NIL_INDEX;
+        this->hash_link = NIL_INDEX;
+        this->aux_prev = NIL_INDEX;
+        this->aux_next = NIL_INDEX;
     }
 };
 
 class SimpleHashTable {
 private:
-    vector<PageMeta*> buckets;
+    vector<uint32_t> buckets;
+    PageMeta* pool;
     int size;
     int mask;
 
 public:
-    void init(int frame_size) {
+    void init(int frame_size, PageMeta* node_pool) {
         // Find the nearest power of 2 as Hash Table size
         size = 1;
         while (size < frame_size * HASH_TABLE_RATIO) {
             size <<= 1;
         }
-        buckets.assign(size, nullptr);
+        buckets.assign(size, NIL_INDEX);
         mask = size - 1;
+        pool = node_pool;
     }
 
     inline int hash_func(unsigned long long key) {
         return (key ^ (key >> 5)) & mask;
     }
 
-    inline PageMeta* get(unsigned long long page_number) {
+    inline uint32_t get(unsigned long long page_number) {
         int idx = hash_func(page_number);
-        PageMeta* curr = buckets[idx];
-        while (curr) {
-            if (curr->page_number == page_number) return curr;
-            curr = curr->hash_next;
+        uint32_t curr = buckets[idx];
+        while (curr != NIL_INDEX) {
+            if (pool[curr].page_number == page_number) return curr;
+            curr = pool[curr].hash_link;
         }
-        return nullptr;
+        return NIL_INDEX;
     }
 
-    inline void put(PageMeta* node) {
-        int idx = hash_func(node->page_number);
-        node->hash_next = buckets[idx]; // insert in front
+    inline void put(uint32_t node) {
+        int idx = hash_func(pool[node].page_number);
+        pool[node].hash_link = buckets[idx]; // insert in front
         buckets[idx] = node;
     }
 
-    inline void remove(PageMeta* node) {
-        int idx = hash_func(node->page_number);
-        PageMeta* curr = buckets[idx];
-        PageMeta* prev = nullptr;
+    inline void remove(uint32_t node) {
+        int idx = hash_func(pool[node].page_number);
+        uint32_t curr = buckets[idx];
+        uint32_t prev = NIL_INDEX;
         
-        while (curr) {
+        while (curr != NIL_INDEX) {
             if (curr == node) {
-                if (prev) {
-                    prev->hash_next = curr->hash_next;
+                if (prev != NIL_INDEX) {
+                    pool[prev].hash_link = pool[curr].hash_link;
                 } else {
-                    buckets[idx] = curr->hash_next;
+                    buckets[idx] = pool[curr].hash_link;
                 }
                 return;
             }
             prev = curr;
-            curr = curr->hash_next;
+            curr = pool[curr].hash_link;
         }
     }
 };
 
-class LRUPageCache {
+// Swiss table style page table (open addressing). One control byte per slot:
+// EMPTY, DELETED or the low 7 bits of the hash of the page stored there. A lookup
+// compares a whole group of control bytes against those 7 bits with one SIMD
+// compare. A slot only holds the node index and the page number is checked in the
+// node, which the cache reads right after the lookup anyway, so a hit costs one
+// group of control bytes plus the node, the same lines as the chained table.
+#define CTRL_EMPTY ((int8_t)-128) // 0b10000000
+#define CTRL_DELETED ((int8_t)-2) // 0b11111110
+// max load 1/2, tombstones included. The cache never grows the table but evicts and
+// inserts all the time, at 7/8 tombstones pile up until every miss probes far
+#define SWISS_MAX_LOAD_NUM 1
+#define SWISS_MAX_LOAD_DEN 2
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GROUP_WIDTH 32
+typedef uint32_t GroupMask;
+struct Group {
+    __m256i ctrl;
+    explicit Group(const int8_t* pos) : ctrl(_mm256_loadu_si256((const __m256i*)pos)) {}
+    inline GroupMask match(int8_t h2) const { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl)); }
+    inline GroupMask match_empty() const { return match(CTRL_EMPTY); }
+    inline GroupMask match_empty_or_deleted() const { // both have the sign bit set, full slots don't
+        return _mm256_movemask_epi8(ctrl);
+    }
+};
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GROUP_WIDTH 16
+typedef uint32_t GroupMask;
+struct Group {
+    __m128i ctrl;
+    explicit Group(const int8_t* pos) : ctrl(_mm_loadu_si128((const __m128i*)pos)) {}
+    inline GroupMask match(int8_t h2) const { return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)); }
+    inline GroupMask match_empty() const { return match(CTRL_EMPTY); }
+    inline GroupMask match_empty_or_deleted() const { return _mm_movemask_epi8(ctrl); }
+};
+#else
+#define GROUP_WIDTH 16
+typedef uint32_t GroupMask;
+struct Group { // portable fallback, same semantics byte by byte
+    int8_t ctrl[GROUP_WIDTH];
+    explicit Group(const int8_t* pos) { memcpy(ctrl, pos, GROUP_WIDTH); }
+    inline GroupMask match(int8_t h2) const {
+        GroupMask mask = 0;
+        for (int i = 0; i < GROUP_WIDTH; i++) mask |= GroupMask(ctrl[i] == h2) << i;
+        return mask;
+    }
+    inline GroupMask match_empty() const { return match(CTRL_EMPTY); }
+    inline GroupMask match_empty_or_deleted() const {
+        GroupMask mask = 0;
+        for (int i = 0; i < GROUP_WIDTH; i++) mask |= GroupMask(ctrl[i] < 0) << i;
+        return mask;
+    }
+};
+#endif
+
+class SwissPageTable {
 private:
+    vector<int8_t> ctrl; // capacity + GROUP_WIDTH, the tail mirrors the first group so loads never wrap
+    // only the node index, the key is compared in the node itself which the cache touches anyway
+    vector<uint32_t> slots;
+    PageMeta* pool;
+    size_t capacity = 0; // power of 2
+    size_t mask = 0;
+    size_t growth_left = 0; // free slots before the load limit, tombstones use them up
+    // a miss in get() remembers where the page would go, the cache inserts that
+    // same page right after (maybe after one eviction), so put() can skip the probe
+    unsigned long long hint_page;
+    size_t hint_slot;
+    size_t hint_group; // start of the first probed group
+    bool hint_in_first_group;
+    bool hint_valid = false;
+
+    static inline uint64_t hash_func(unsigned long long key) {
+        key *= 0x9E3779B97F4A7C15ull;
+        return key ^ (key >> 29);
+    }
+    static inline size_t h1(uint64_t hash) { return hash >> 7; }
+    static inline int8_t h2(uint64_t hash) { return hash & 0x7f; }
+
+    inline void set_ctrl(size_t i, int8_t value) {
+        ctrl[i] = value;
+        if (i < GROUP_WIDTH) ctrl[capacity + i] = value; // keep the mirror in sync
+    }
+    inline void fill_slot(size_t i, int8_t tag, uint32_t node) {
+        set_ctrl(i, tag);
+        slots[i] = node;
+        pool[node].hash_link = i;
+    }
+    // first EMPTY or DELETED slot on the probe sequence of hash
+    inline size_t find_free_slot(uint64_t hash) {
+        size_t pos = h1(hash) & mask;
+        for (size_t step = GROUP_WIDTH;; pos = (pos + step) & mask, step += GROUP_WIDTH) { // triangular probing
+            GroupMask free_mask = Group(&ctrl[pos]).match_empty_or_deleted();
+            if (free_mask) return (pos + __builtin_ctz(free_mask)) & mask;
+        }
+    }
+    // too many tombstones: reinsert everything into a clean table of the same size
+    void rehash() {
+        hint_valid = false;
+        vector<uint32_t> old;
+        old.reserve(capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            if (ctrl[i] >= 0) old.push_back(slots[i]);
+        }
+        ctrl.assign(capacity + GROUP_WIDTH, CTRL_EMPTY);
+        growth_left = capacity * SWISS_MAX_LOAD_NUM / SWISS_MAX_LOAD_DEN;
+        for (uint32_t node : old) {
+            uint64_t hash = hash_func(pool[node].page_number);
+            fill_slot(find_free_slot(hash), h2(hash), node);
+            growth_left--;
+        }
+    }
+
+public:
+    void init(int max_nodes, PageMeta* node_pool) {
+        // keep at least max_nodes / 8 slots of slack above a full cache, so the
+        // tombstone clean up (rehash) runs at most once every max_nodes / 8 inserts
+        capacity = GROUP_WIDTH;
+        while (capacity * SWISS_MAX_LOAD_NUM / SWISS_MAX_LOAD_DEN < (size_t)max_nodes + max_nodes / 8 + 1) {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        ctrl.assign(capacity + GROUP_WIDTH, CTRL_EMPTY);
+        slots.resize(capacity);
+        growth_left = capacity * SWISS_MAX_LOAD_NUM / SWISS_MAX_LOAD_DEN;
+        pool = node_pool;
+        hint_valid = false;
+    }
+
+    inline uint32_t get(unsigned long long page_number) {
+        uint64_t hash = hash_func(page_number);
+        size_t pos = h1(hash) & mask;
+        bool first_group = true;
+        hint_valid = false;
+        for (size_t step = GROUP_WIDTH;; pos = (pos + step) & mask, step += GROUP_WIDTH) {
+            Group group(&ctrl[pos]);
+            for (GroupMask match = group.match(h2(hash)); match; match &= match - 1) {
+                size_t i = (pos + __builtin_ctz(match)) & mask;
+                if (pool[slots[i]].page_number == page_number) return slots[i];
+            }
+            if (!hint_valid) {
+                GroupMask free_mask = group.match_empty_or_deleted();
+                if (free_mask) {
+                    hint_page = page_number;
+                    hint_slot = (pos + __builtin_ctz(free_mask)) & mask;
+                    hint_group = pos;
+                    hint_in_first_group = first_group;
+                    hint_valid = true;
+                }
+            }
+            if (group.match_empty()) return NIL_INDEX; // an EMPTY ends the probe sequence
+            first_group = false;
+        }
+    }
+
+    // the page must not be in the table yet
+    inline void put(uint32_t node) {
+        if (growth_left == 0) rehash();
+        unsigned long long page_number = pool[node].page_number;
+        uint64_t hash = hash_func(page_number);
+        size_t i = (hint_valid && hint_page == page_number) ? hint_slot : find_free_slot(hash);
+        hint_valid = false;
+        if (ctrl[i] == CTRL_EMPTY) growth_left--; // reusing a tombstone costs nothing
+        fill_slot(i, h2(hash), node);
+    }
+
+    inline void remove(uint32_t node) {
+        size_t i = pool[node].hash_link; // no lookup, the node knows its slot
+        // if no probe could have passed this slot while the group around it was full,
+        // it can go back to EMPTY instead of becoming a tombstone
+        GroupMask empty_after = Group(&ctrl[i]).match_empty();
+        GroupMask empty_before = Group(&ctrl[(i - GROUP_WIDTH) & mask]).match_empty();
+        bool was_never_full = empty_before && empty_after &&
+            (__builtin_ctz(empty_after) + __builtin_clz(empty_before) - (32 - GROUP_WIDTH)) < GROUP_WIDTH;
+        if (was_never_full) {
+            set_ctrl(i, CTRL_EMPTY);
+            growth_left++;
+            // a new EMPTY in front of the hint would end the probe before reaching it
+            if (hint_valid && (!hint_in_first_group ||
+                               ((i - hint_group) & mask) < ((hint_slot - hint_group) & mask))) {
+                hint_valid = false;
+            }
+        } else {
+            set_ctrl(i, CTRL_DELETED);
+        }
+    }
+};
+
+struct PageList {
+    uint32_t head = NIL_INDEX; // MRU
+    uint32_t tail = NIL_INDEX;
+    int size = 0;
+};
+
+// ---------------- policy framework ----------------
+// PageCacheCore owns what every policy shares: the node pool, the page table,
+// the lists and the counters. A policy only decides which lists a page moves
+// between; PageCache<Policy> calls it statically so the hot loop has no virtual call.
+// Policies that keep history (ARC, 2Q, LIRS, CLOCK-Pro) leave non-resident
+// "ghost" nodes in the page table, a lookup is a hit only if the node is resident.
+class PageCacheCore {
+public:
     vector<PageMeta> node_pool; // 一次先要一整塊存page meta的記憶體，避免一直new/delete
-    vector<PageMeta*> free_list; // 有哪些page空間是空的可以用
-    int size;
-    SimpleHashTable map;
-    PageMeta* head = nullptr; // MRU
-    PageMeta* tail = nullptr; // LRU 
+    PageMeta* pool;
+    vector<uint32_t> free_nodes; // nodes released by ghost policies
+    uint32_t used = 0; // node_pool[0, used) have been handed out at least once
+    int frames;
+    int resident = 0;
+    SwissPageTable map;
+    PageList lists[LIST_MASK + 1]; // primary links (prev/next), lists[0] is unused
+    PageList aux_lists[4]; // aux links (aux_prev/aux_next), aux_lists[0] is unused
     long long hit = 0;
     long long miss = 0;
     long long write_back = 0;
-public:
-    LRUPageCache(int frames) {
-        node_pool.resize(frames);
-        free_list.reserve(frames);
-        for (int i = 0; i < frames; i++) {
-            free_list.push_back(&node_pool[i]);
+
+    void init(int frames, int max_nodes) {
+        this->frames = frames;
+        node_pool.resize(max_nodes);
+        pool = node_pool.data();
+        map.init(max_nodes, pool);
+    }
+    inline bool full() const { return resident >= frames; }
+
+    // a new resident page, registered in the page table
+    inline uint32_t new_node(TraceItem trace) {
+        uint32_t index;
+        if (!free_nodes.empty()) {
+            index = free_nodes.back();
+            free_nodes.pop_back();
+        } else {
+            index = used++;
         }
-        map.init(frames);
+        pool[index].initialize(trace.page_number, trace.is_write);
+        map.put(index);
+        resident++;
+        return index;
     }
-    void access_page(TraceItem trace) {
-        PageMeta* target_page = map.get(trace.page_number);
+    // a ghost node gets its page back
+    inline void revive(uint32_t index, bool is_write) {
+        pool[index].set(RESIDENT_BIT);
+        if (is_write) pool[index].set(DIRTY_BIT);
+        resident++;
+    }
+    // drop the page data, the node itself may stay as history
+    inline void evict(uint32_t index) {
+        if (pool[index].dirty()) write_back++; // is written, write back
+        pool[index].clear(DIRTY_BIT | RESIDENT_BIT | REF_BIT);
+        resident--;
+    }
+    // forget the page completely, it must already be out of every list
+    inline void release(uint32_t index) {
+        map.remove(index);
+        free_nodes.push_back(index);
+    }
+
+    inline void push_front(int list_type, uint32_t index) {
+        PageMeta& node = pool[index];
+        PageList& list = lists[list_type];
+        node.next = list.head;
+        node.prev = NIL_INDEX;
+        if (list.head != NIL_INDEX) pool[list.head].prev = index;
+        list.head = index;
+        if (list.tail == NIL_INDEX) list.tail = index;
+        list.size++;
+        node.set_list_type(list_type);
+    }
+    inline void remove_from_list(uint32_t index) {
+        PageMeta& node = pool[index];
+        PageList& list = lists[node.list_type()];
+        if (node.prev != NIL_INDEX) pool[node.prev].next = node.next;
+        else list.head = node.next;
+        if (node.next != NIL_INDEX) pool[node.next].prev = node.prev;
+        else list.tail = node.prev;
+        list.size--;
+        node.set_list_type(0);
+    }
+    inline void move_to_front(int list_type, uint32_t index) {
+        remove_from_list(index);
+        push_front(list_type, index);
+    }
+
+    inline void aux_push_front(int list_type, uint32_t index) {
+        PageMeta& node = pool[index];
+        PageList& list = aux_lists[list_type];
+        node.aux_next = list.head;
+        node.aux_prev = NIL_INDEX;
+        if (list.head != NIL_INDEX) pool[list.head].aux_prev = index;
+        list.head = index;
+        if (list.tail == NIL_INDEX) list.tail = index;
+        list.size++;
+        node.set_aux_list_type(list_type);
+    }
+    inline void aux_remove(uint32_t index) {
+        PageMeta& node = pool[index];
+        PageList& list = aux_lists[node.aux_list_type()];
+        if (node.aux_prev != NIL_INDEX) pool[node.aux_prev].aux_next = node.aux_next;
+        else list.head = node.aux_next;
+        if (node.aux_next != NIL_INDEX) pool[node.aux_next].aux_prev = node.aux_prev;
+        else list.tail = node.aux_prev;
+        list.size--;
+        node.set_aux_list_type(0);
+    }
+
+    void print_linklist(int list_type){
+        uint32_t curr = lists[list_type].head;
+        while (curr != NIL_INDEX){
+            cout << "[" << pool[curr].page_number << (pool[curr].dirty() ? " D" : " C") << "] ";
+            curr = pool[curr].next;
+        }
+        cout << endl;
+    }
+};
+
+template <class Policy>
+class PageCache : public PageCacheCore {
+private:
+    Policy policy;
+public:
+    PageCache(int frames) {
+        init(frames, Policy::max_nodes(frames));
+        policy.init(*this);
+    }
+    inline void access_page(TraceItem trace) {
+        uint32_t target_page = map.get(trace.page_number);
 
-        if (target_page){ // hit
+        if (target_page != NIL_INDEX && pool[target_page].resident()){ // hit
             hit++;
-            if (trace.is_write) target_page->dirty = true;
-
-            // to MRU
-            if (target_page != head){
-                // remove
-                if (target_page->prev) target_page->prev->next = target_page->next;
-                if (target_page->next) target_page->next->prev = target_page->prev;
-                if (target_page == tail) tail = target_page->prev;
-                // to head
-                target_page->next = head;
-                target_page->prev = nullptr;
-                if (head) head->prev = target_page;
-                head = target_page;
-            }
-        } else { // miss
+            if (trace.is_write) pool[target_page].set(DIRTY_BIT);
+            policy.on_hit(*this, target_page);
+        } else { // miss, target_page may be a ghost node
             miss++;
-            PageMeta* new_cache_page = nullptr;
-            if (!free_list.empty()){
-                new_cache_page = free_list.back();
-                free_list.pop_back();
-            } else { // the size of cache is full
-                PageMeta* page_to_remove = tail;
+            policy.on_miss(*this, target_page, trace);
+        }
+    }
+    SimResult stats(int frames) {
+        return {frames, hit, miss, write_back};
+    }
+};
 
-                if (page_to_remove->dirty) write_back++; // is written, write back
-                map.remove(page_to_remove);
+class LRUPolicy {
+private:
+    enum { LRU_LIST = 1 };
+public:
+    static int max_nodes(int frames) { return frames; }
+    void init(PageCacheCore& cache) {}
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        // to MRU
+        if (page != cache.lists[LRU_LIST].head) cache.move_to_front(LRU_LIST, page);
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        if (cache.full()) { // the size of cache is full
+            uint32_t page_to_remove = cache.lists[LRU_LIST].tail;
+            cache.remove_from_list(page_to_remove);
+            cache.evict(page_to_remove);
+            cache.release(page_to_remove); // Reuse memory
+        }
+        cache.push_front(LRU_LIST, cache.new_node(trace));
+    }
+};
 
-                if (tail->prev) tail = tail->prev, tail->next = nullptr; // is tail
-                else head = nullptr, tail = nullptr; // is tail & head
+class CFLRUPolicy {
+private:
+    enum { WORKING = 1, CLEAN = 2, DIRTY = 3 };
+    int working_cap = 0;
+    inline void move_to_CFlist(PageCacheCore& cache){
+        uint32_t node = cache.lists[WORKING].tail;
+        if (node == NIL_INDEX) return;
+        cache.remove_from_list(node); 
+
+        // 2. 根據 Dirty 狀態分流
+        cache.push_front(cache.pool[node].dirty() ? DIRTY : CLEAN, node);
+    }
+public:
+    static int max_nodes(int frames) { return frames; }
+    void init(PageCacheCore& cache) {
+        working_cap = cache.frames * 3 / 4;
+    }
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        // to MRU
+        if (page != cache.lists[WORKING].head){
+            cache.move_to_front(WORKING, page);
+            if (cache.lists[WORKING].size > working_cap) move_to_CFlist(cache);
+        }
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        if (cache.full()) { // the size of cache is full
+            uint32_t page_to_remove = cache.lists[CLEAN].tail; // default remove tail of clean list
+            if (page_to_remove == NIL_INDEX){ // no clean => degrade to LRU
+                page_to_remove = cache.lists[DIRTY].tail;
+            }
+            cache.remove_from_list(page_to_remove);
+            cache.evict(page_to_remove);
+            cache.release(page_to_remove);
+        }
+        cache.push_front(WORKING, cache.new_node(trace));
+        if (cache.lists[WORKING].size > working_cap) move_to_CFlist(cache);
+    }
+};
 
-                new_cache_page = page_to_remove; // Reuse memory
+// second chance: the list is a FIFO, a referenced tail gets its bit cleared and goes back to the head
+class CLOCKPolicy {
+private:
+    enum { CLOCK_LIST = 1 };
+public:
+    static int max_nodes(int frames) { return frames; }
+    void init(PageCacheCore& cache) {}
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        cache.pool[page].set(REF_BIT);
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        if (cache.full()) {
+            uint32_t hand = cache.lists[CLOCK_LIST].tail;
+            while (cache.pool[hand].has(REF_BIT)) {
+                cache.pool[hand].clear(REF_BIT);
+                cache.move_to_front(CLOCK_LIST, hand);
+                hand = cache.lists[CLOCK_LIST].tail;
             }
-            new_cache_page->initialize(trace.page_number, trace.is_write);
+            cache.remove_from_list(hand);
+            cache.evict(hand);
+            cache.release(hand);
+        }
+        uint32_t page = cache.new_node(trace);
+        cache.pool[page].set(REF_BIT);
+        cache.push_front(CLOCK_LIST, page);
+    }
+};
 
-            // to MRU
-            new_cache_page->next = head;
-            new_cache_page->prev = nullptr;
-            if (head) head->prev = new_cache_page;
-            head = new_cache_page;
-            if (!tail) tail = head;
+// 2Q (Johnson & Shasha): A1in FIFO for first touches, A1out remembers pages
+// evicted from A1in, a page seen again while in A1out goes to the LRU list Am
+class TwoQPolicy {
+private:
+    enum { A1IN = 1, A1OUT = 2, AM = 3 };
+    int kin = 1;
+    int kout = 1;
+public:
+    static int max_nodes(int frames) { return frames + frames / 2 + 1; }
+    void init(PageCacheCore& cache) {
+        kin = max(1, cache.frames / 4);
+        kout = max(1, cache.frames / 2);
+    }
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        if (cache.pool[page].list_type() == AM && page != cache.lists[AM].head) {
+            cache.move_to_front(AM, page);
+        } // hit in A1in: stays where it is
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        if (cache.full()) {
+            if (cache.lists[A1IN].size > kin || cache.lists[AM].size == 0) {
+                uint32_t victim = cache.lists[A1IN].tail;
+                cache.evict(victim);
+                cache.move_to_front(A1OUT, victim);
+                if (cache.lists[A1OUT].size > kout) {
+                    uint32_t oldest = cache.lists[A1OUT].tail;
+                    if (oldest == ghost) ghost = NIL_INDEX;
+                    cache.remove_from_list(oldest);
+                    cache.release(oldest);
+                }
+            } else {
+                uint32_t victim = cache.lists[AM].tail;
+                cache.remove_from_list(victim);
+                cache.evict(victim);
+                cache.release(victim);
+            }
+        }
+        if (ghost != NIL_INDEX) { // remembered in A1out
+            cache.revive(ghost, trace.is_write);
+            cache.move_to_front(AM, ghost);
+        } else {
+            cache.push_front(A1IN, cache.new_node(trace));
+        }
+    }
+};
 
-            map.put(new_cache_page);
+// ARC (Megiddo & Modha): T1/T2 hold pages seen once/twice recently, B1/B2 are
+// their ghosts, hits in the ghosts move the target size p of T1
+class ARCPolicy {
+private:
+    enum { T1 = 1, T2 = 2, B1 = 3, B2 = 4 };
+    int p = 0;
+    inline void replace(PageCacheCore& cache, bool in_b2) {
+        int t1 = cache.lists[T1].size;
+        if (t1 >= 1 && ((in_b2 && t1 == p) || t1 > p)) {
+            uint32_t victim = cache.lists[T1].tail;
+            cache.evict(victim);
+            cache.move_to_front(B1, victim);
+        } else {
+            uint32_t victim = cache.lists[T2].tail;
+            cache.evict(victim);
+            cache.move_to_front(B2, victim);
         }
     }
-    void print_stats(int frames) {
-        printf("%d\t%lld\t%lld\t\t%.10f\t\t%lld\n", 
-               frames, hit, miss, (double)miss / (hit + miss), write_back);
+    inline void drop_tail(PageCacheCore& cache, int list_type) {
+        uint32_t victim = cache.lists[list_type].tail;
+        cache.remove_from_list(victim);
+        if (cache.pool[victim].resident()) cache.evict(victim);
+        cache.release(victim);
     }
-    void print_linklist(){
-        PageMeta* curr = head;
-        while (curr){
-            cout << "[" << curr->page_number << (curr->dirty ? " D" : " C") << "] ";
-            curr = curr->next;
+public:
+    static int max_nodes(int frames) { return 2 * frames + 1; }
+    void init(PageCacheCore& cache) {}
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        if (page != cache.lists[T2].head) cache.move_to_front(T2, page);
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        int c = cache.frames;
+        PageList* lists = cache.lists;
+        if (ghost != NIL_INDEX) {
+            bool in_b2 = cache.pool[ghost].list_type() == B2;
+            if (!in_b2) {
+                p = min(c, p + max(lists[B2].size / lists[B1].size, 1));
+            } else {
+                p = max(0, p - max(lists[B1].size / lists[B2].size, 1));
+            }
+            if (cache.full()) replace(cache, in_b2);
+            cache.revive(ghost, trace.is_write);
+            cache.move_to_front(T2, ghost);
+            return;
         }
-        cout << endl;
+
+        int l1 = lists[T1].size + lists[B1].size;
+        int total = l1 + lists[T2].size + lists[B2].size;
+        if (l1 == c) {
+            if (lists[T1].size < c) {
+                drop_tail(cache, B1);
+                if (cache.full()) replace(cache, false);
+            } else {
+                drop_tail(cache, T1);
+            }
+        } else if (total >= c) {
+            if (total >= 2 * c) drop_tail(cache, B2);
+            if (cache.full()) replace(cache, false);
+        }
+        cache.push_front(T1, cache.new_node(trace));
     }
 };
 
-class CFLRUPageCache {
+// LIRS (Jiang & Zhang): stack S orders pages by recency and keeps the LIR set
+// (low inter-reference recency), resident HIR pages wait in queue Q for eviction.
+// Non-resident HIR pages stay in S as history, bounded by a ghost FIFO of `frames` entries.
+class LIRSPolicy {
 private:
-    vector<PageMeta> node_pool; // 一次先要一整塊存page meta的記憶體，避免一直new/delete
-    vector<PageMeta*> free_list; // 有哪些page空間是空的可以用
-    int size;
-    int working_cap = 0;
-    SimpleHashTable map;
-    PageMeta* working_head = nullptr; // MRU
-    PageMeta* working_tail = nullptr;
-    int working_size = 0;
-    PageMeta* dirty_head = nullptr;
-    PageMeta* dirty_tail = nullptr;
-    PageMeta* clean_head = nullptr;
-    PageMeta* clean_tail = nullptr;
-    long long hit = 0;
-    long long miss = 0;
-    long long write_back = 0;
+    enum { STACK_S = 1 }; // primary list
+    enum { QUEUE_Q = 1, GHOSTS = 2 }; // aux lists
+    int lir_cap = 1;
+    int lir_size = 0;
+    inline bool is_lir(PageCacheCore& cache, uint32_t page) { return cache.pool[page].has(HOT_BIT); }
+    inline bool in_stack(PageCacheCore& cache, uint32_t page) { return cache.pool[page].list_type() == STACK_S; }
+
+    // S must end with a LIR page, HIR pages under it have no use as history
+    inline void prune(PageCacheCore& cache) {
+        uint32_t bottom = cache.lists[STACK_S].tail;
+        while (bottom != NIL_INDEX && !is_lir(cache, bottom)) {
+            cache.remove_from_list(bottom);
+            if (!cache.pool[bottom].resident()) {
+                cache.aux_remove(bottom);
+                cache.release(bottom);
+            }
+            bottom = cache.lists[STACK_S].tail;
+        }
+    }
+    // a page just became LIR, the LIR page at the bottom of S turns into a resident HIR page
+    inline void rebalance(PageCacheCore& cache) {
+        if (lir_size <= lir_cap) return;
+        uint32_t bottom = cache.lists[STACK_S].tail;
+        cache.pool[bottom].clear(HOT_BIT);
+        lir_size--;
+        cache.remove_from_list(bottom);
+        cache.aux_push_front(QUEUE_Q, bottom);
+        prune(cache);
+    }
 public:
-    CFLRUPageCache(int frames) {
-        node_pool.resize(frames);
-        free_list.reserve(frames);
-        for (int i = 0; i < frames; i++) {
-            free_list.push_back(&node_pool[i]);
-        }
-        map.init(frames);
-        working_cap = frames * 3 / 4;
-    }
-    void remove_from_list(PageMeta* node) {
-        if (node->prev) node->prev->next = node->next;
-        if (node->next) node->next->prev = node->prev;
-        
-        if (node->list_type == "WORKING") {
-            if (node == working_head) working_head = node->next;
-            if (node == working_tail) working_tail = node->prev;
-            working_size--;
-        } 
-        else if (node->list_type == "CLEAN") {
-            if (node == clean_head) clean_head = node->next;
-            if (node == clean_tail) clean_tail = node->prev;
-        } 
-        else if (node->list_type == "DIRTY") {
-            if (node == dirty_head) dirty_head = node->next;
-            if (node == dirty_tail) dirty_tail = node->prev;
-        }
-        node->list_type = "NONE";
-    }
-    void add_to_list(PageMeta* node, string list_type) {
-        PageMeta** head_ptr = nullptr;
-        PageMeta** tail_ptr = nullptr;
-        if (list_type == "WORKING") {
-            head_ptr = &working_head; tail_ptr = &working_tail;
-            working_size++;
-        } else if (list_type == "CLEAN") {
-            head_ptr = &clean_head; tail_ptr = &clean_tail;
-        } else if (list_type == "DIRTY") {
-            head_ptr = &dirty_head; tail_ptr = &dirty_tail;
-        }
-
-        node->next = *head_ptr;
-        node->prev = nullptr;
-        if (*head_ptr) (*head_ptr)->prev = node;
-        *head_ptr = node;
-        if (!*tail_ptr) *tail_ptr = node;
-        
-        node->list_type = list_type;
+    static int max_nodes(int frames) { return 2 * frames + 1; }
+    void init(PageCacheCore& cache) {
+        int hir_cap = max(1, cache.frames / 100);
+        lir_cap = max(1, cache.frames - hir_cap);
     }
-    void move_to_CFlist(){
-        if (!working_tail) return;
-        PageMeta* node = working_tail;
-        remove_from_list(node); 
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        if (is_lir(cache, page)) {
+            bool was_bottom = page == cache.lists[STACK_S].tail;
+            cache.move_to_front(STACK_S, page);
+            if (was_bottom) prune(cache);
+        } else if (in_stack(cache, page)) { // HIR with a short reuse distance becomes LIR
+            cache.aux_remove(page);
+            cache.pool[page].set(HOT_BIT);
+            lir_size++;
+            cache.move_to_front(STACK_S, page);
+            rebalance(cache);
+        } else {
+            cache.push_front(STACK_S, page);
+            cache.aux_remove(page);
+            cache.aux_push_front(QUEUE_Q, page);
+        }
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        if (cache.full()) {
+            uint32_t victim = cache.aux_lists[QUEUE_Q].tail;
+            cache.aux_remove(victim);
+            cache.evict(victim);
+            if (in_stack(cache, victim)) {
+                cache.aux_push_front(GHOSTS, victim);
+            } else {
+                cache.release(victim);
+            }
+        }
 
-        // 2. 根據 Dirty 狀態分流
-        if (node->dirty) {
-            add_to_list(node, "DIRTY");
+        if (ghost != NIL_INDEX) { // non-resident HIR still in S
+            cache.aux_remove(ghost);
+            cache.revive(ghost, trace.is_write);
+            cache.pool[ghost].set(HOT_BIT);
+            lir_size++;
+            cache.move_to_front(STACK_S, ghost);
+            rebalance(cache);
         } else {
-            add_to_list(node, "CLEAN");
+            uint32_t page = cache.new_node(trace);
+            cache.push_front(STACK_S, page);
+            if (lir_size < lir_cap) { // warm up, fill the LIR set first
+                cache.pool[page].set(HOT_BIT);
+                lir_size++;
+            } else {
+                cache.aux_push_front(QUEUE_Q, page);
+            }
+        }
+
+        if (cache.aux_lists[GHOSTS].size > cache.frames) {
+            uint32_t oldest = cache.aux_lists[GHOSTS].tail;
+            cache.aux_remove(oldest);
+            cache.remove_from_list(oldest);
+            cache.release(oldest);
         }
     }
-    void access_page(TraceItem trace) {
-        PageMeta* target_page = map.get(trace.page_number);
+};
 
-        if (target_page){ // hit
-            hit++;
-            if (trace.is_write) target_page->dirty = true;
+// CLOCK-Pro (Jiang, Chen & Zhang): the CLOCK approximation of LIRS. Hot, cold and
+// non-resident cold pages share one ring swept by HAND_hot, which demotes
+// unreferenced hot pages and ends the test periods it passes. Resident cold and
+// non-resident pages are also threaded on aux lists in ring order, so HAND_cold
+// and HAND_test jump straight to their next candidate instead of walking over hot
+// pages. The cold target m_c grows when a page comes back within its test period
+// and shrinks when a test period expires.
+class CLOCKProPolicy {
+private:
+    enum { COLD = 1, NONRESIDENT = 2 }; // aux lists, the tail is where the hand points
+    uint32_t hand_hot = NIL_INDEX;
+    int hot_size = 0;
+    int cold_target = 1;
 
-            // to MRU
-            if (target_page != working_head){
-                remove_from_list(target_page);
-                add_to_list(target_page, "WORKING");
-                if (working_size > working_cap) move_to_CFlist();
+    // the ring reuses prev/next, new pages go in right behind HAND_hot (the list head)
+    inline void ring_insert(PageCacheCore& cache, uint32_t page) {
+        PageMeta* pool = cache.pool;
+        if (hand_hot == NIL_INDEX) {
+            pool[page].prev = pool[page].next = page;
+            hand_hot = page;
+            return;
+        }
+        uint32_t before = pool[hand_hot].prev;
+        pool[page].prev = before;
+        pool[page].next = hand_hot;
+        pool[before].next = page;
+        pool[hand_hot].prev = page;
+    }
+    inline void ring_remove(PageCacheCore& cache, uint32_t page) {
+        PageMeta* pool = cache.pool;
+        uint32_t next = pool[page].next;
+        if (next == page) {
+            hand_hot = NIL_INDEX;
+            return;
+        }
+        if (hand_hot == page) hand_hot = next;
+        pool[pool[page].prev].next = next;
+        pool[next].prev = pool[page].prev;
+    }
+    inline void forget_nonresident(PageCacheCore& cache, uint32_t page) {
+        cache.aux_remove(page);
+        ring_remove(cache, page);
+        cache.release(page);
+        cold_target = max(1, cold_target - 1);
+    }
+    void run_hand_hot(PageCacheCore& cache) {
+        PageMeta* pool = cache.pool;
+        while (true) {
+            uint32_t page = hand_hot;
+            if (pool[page].has(HOT_BIT)) {
+                hand_hot = pool[page].next;
+                if (pool[page].has(REF_BIT)) {
+                    pool[page].clear(REF_BIT);
+                } else { // demote
+                    pool[page].clear(HOT_BIT);
+                    hot_size--;
+                    cache.aux_push_front(COLD, page);
+                    return;
+                }
+            } else if (pool[page].has(TEST_BIT)) { // HAND_hot passing a cold page ends its test period
+                pool[page].clear(TEST_BIT);
+                if (!pool[page].resident()) forget_nonresident(cache, page);
+                else hand_hot = pool[page].next;
+            } else {
+                hand_hot = pool[page].next;
             }
-        } else { // miss
-            miss++;
-            PageMeta* new_cache_page = nullptr;
-            if (!free_list.empty()){
-                new_cache_page = free_list.back();
-                free_list.pop_back();
-            } else { // the size of cache is full
-                PageMeta* page_to_remove = clean_tail; // default remove tail of clean list
-                if (!page_to_remove){ // no clean => degrade to LRU
-                    page_to_remove = dirty_tail;
+        }
+    }
+    inline void run_hand_test(PageCacheCore& cache) {
+        forget_nonresident(cache, cache.aux_lists[NONRESIDENT].tail);
+    }
+    void run_hand_cold(PageCacheCore& cache) {
+        PageMeta* pool = cache.pool;
+        while (true) {
+            uint32_t page = cache.aux_lists[COLD].tail;
+            cache.aux_remove(page);
+            if (pool[page].has(REF_BIT)) {
+                pool[page].clear(REF_BIT);
+                ring_remove(cache, page);
+                ring_insert(cache, page);
+                if (pool[page].has(TEST_BIT)) { // reused within its test period => hot
+                    pool[page].clear(TEST_BIT);
+                    pool[page].set(HOT_BIT);
+                    hot_size++;
+                    while (hot_size > cache.frames - cold_target) run_hand_hot(cache);
+                } else { // a new test period
+                    pool[page].set(TEST_BIT);
+                    cache.aux_push_front(COLD, page);
                 }
+                continue;
+            }
+            cache.evict(page);
+            if (pool[page].has(TEST_BIT)) { // keep its history until the test period ends
+                cache.aux_push_front(NONRESIDENT, page);
+            } else {
+                ring_remove(cache, page);
+                cache.release(page);
+            }
+            return;
+        }
+    }
+public:
+    static int max_nodes(int frames) { return 2 * frames + 2; }
+    void init(PageCacheCore& cache) {
+        cold_target = max(1, cache.frames / 100);
+    }
+    inline void on_hit(PageCacheCore& cache, uint32_t page) {
+        cache.pool[page].set(REF_BIT);
+    }
+    inline void on_miss(PageCacheCore& cache, uint32_t ghost, TraceItem trace) {
+        if (cache.full()) run_hand_cold(cache);
+        // HAND_hot may have forgotten the ghost while making room
+        if (ghost != NIL_INDEX && cache.map.get(trace.page_number) != ghost) ghost = NIL_INDEX;
 
-                if (page_to_remove->dirty) write_back++; // is written, write back
-                map.remove(page_to_remove);
-                remove_from_list(page_to_remove);
-
-                new_cache_page = page_to_remove;
+        if (ghost != NIL_INDEX) { // reused within its test period
+            cold_target = min(cache.frames - 1, cold_target + 1);
+            cache.aux_remove(ghost);
+            ring_remove(cache, ghost);
+            cache.revive(ghost, trace.is_write);
+            cache.pool[ghost].clear(TEST_BIT);
+            cache.pool[ghost].set(HOT_BIT);
+            hot_size++;
+            ring_insert(cache, ghost);
+            while (hot_size > cache.frames - cold_target) run_hand_hot(cache);
+        } else {
+            uint32_t page = cache.new_node(trace);
+            if (hot_size < cache.frames - cold_target) { // warm up, fill the hot set first
+                cache.pool[page].set(HOT_BIT);
+                hot_size++;
+            } else {
+                cache.pool[page].set(TEST_BIT);
+                cache.aux_push_front(COLD, page);
             }
-            new_cache_page->initialize(trace.page_number, trace.is_write);
-            add_to_list(new_cache_page, "WORKING");
-            map.put(new_cache_page);
-            if (working_size > working_cap) move_to_CFlist();
+            ring_insert(cache, page);
         }
+
+        if (cache.aux_lists[NONRESIDENT].size > cache.frames) run_hand_test(cache);
     }
-    void print_stats(int frames) {
-        printf("%d\t%lld\t%lld\t\t%.10f\t\t%lld\n", 
-               frames, hit, miss, (double)miss / (hit + miss), write_back);
+};
+
+// ---------------- trace loading ----------------
+// Binary trace format (*.bin): BinaryTraceHeader followed by one varint per access.
+// varint value = zigzag(page_number - previous page_number) << 1 | is_write
+// so sequential / nearby accesses take 1~2 bytes instead of a text line.
+#define BINARY_TRACE_MAGIC "HW5TRC01"
+
+struct BinaryTraceHeader {
+    char magic[8];
+    uint64_t item_count;
+    uint64_t payload_bytes;
+};
+
+const uint8_t* binary_trace = nullptr; // mmapped payload, nullptr when the trace is loaded as text
+uint64_t binary_trace_items = 0;
+
+static inline void put_varint(vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
     }
-    void print_linklist(){
-        PageMeta* curr = working_head;
-        while (curr){
-            cout << "[" << curr->page_number << (curr->dirty ? " D" : " C") << "] ";
-            curr = curr->next;
+    out.push_back(uint8_t(value));
+}
+
+static inline uint64_t encode_item(unsigned long long prev_page, TraceItem item) {
+    long long delta = (long long)(item.page_number - prev_page);
+    uint64_t zigzag = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+    return (zigzag << 1) | (item.is_write ? 1 : 0);
+}
+
+class BinaryTraceReader {
+private:
+    const uint8_t* cur;
+    unsigned long long prev_page = 0;
+public:
+    BinaryTraceReader(const uint8_t* payload) : cur(payload) {}
+    // streaming decodes buffer after buffer, the previous page carries over
+    const uint8_t* position() const { return cur; }
+    void set_position(const uint8_t* payload) { cur = payload; }
+    // the varint at the position ends before end (its last byte has no continuation bit)
+    bool has_next(const uint8_t* end) const {
+        for (const uint8_t* p = cur; p < end; p++) {
+            if (!(*p & 0x80)) return true;
         }
-        cout << endl;
+        return false;
+    }
+    inline TraceItem next() {
+        uint64_t value = 0;
+        int shift = 0;
+        while (*cur & 0x80) {
+            value |= uint64_t(*cur++ & 0x7f) << shift;
+            shift += 7;
+        }
+        value |= uint64_t(*cur++) << shift;
+        uint64_t zigzag = value >> 1;
+        long long delta = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+        prev_page += delta;
+        return {bool(value & 1), prev_page};
     }
 };
 
-void load_trace_file(const char* filename){
-    FILE* fp = fopen(filename, "r");
-    if (!fp) {
+// iterate every access of the loaded trace, text or binary
+template <class Func>
+void for_each_trace(Func func) {
+    if (binary_trace) {
+        BinaryTraceReader reader(binary_trace);
+        for (uint64_t i = 0; i < binary_trace_items; i++) {
+            func(reader.next());
+        }
+    } else {
+        for (const TraceItem& trace : traces) {
+            func(trace);
+        }
+    }
+}
+
+struct TraceChunk {
+    const char* begin;
+    const char* end;
+    bool encode; // true: varint encode (converter), false: keep TraceItem (simulate text directly)
+    vector<TraceItem> items;
+    vector<uint8_t> encoded; // every item except the first one, relative to the previous item
+    TraceItem first_item = {false, 0};
+    TraceItem last_item = {false, 0};
+    uint64_t count = 0;
+};
+
+static inline bool parse_trace_line(const char*& p, const char* end, TraceItem& item) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if (p >= end) return false;
+    char op = *p++;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p + 1 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+    unsigned long long addr = 0;
+    for (; p < end; p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9') addr = (addr << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f') addr = (addr << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') addr = (addr << 4) | (c - 'A' + 10);
+        else break;
+    }
+    while (p < end && *p != '\n') p++; // ignore the rest of the line
+    item = {(op == 'W'), addr >> 12}; // addr to page number, 4 KB: 2^(2+10)
+    return true;
+}
+
+static void* parse_trace_chunk(void* arg) {
+    TraceChunk* chunk = (TraceChunk*)arg;
+    const char* p = chunk->begin;
+    TraceItem item;
+    if (chunk->encode) chunk->encoded.reserve((chunk->end - chunk->begin) / 8);
+    while (parse_trace_line(p, chunk->end, item)) {
+        if (chunk->encode) {
+            if (chunk->count == 0) chunk->first_item = item;
+            else put_varint(chunk->encoded, encode_item(chunk->last_item.page_number, item));
+        } else {
+            chunk->items.push_back(item);
+        }
+        chunk->last_item = item;
+        chunk->count++;
+    }
+    return nullptr;
+}
+
+static const char* map_file(const char* filename, size_t& length) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         perror("[Error] Open trace file failed");
         exit(1);
     }
+    struct stat st;
+    fstat(fd, &st);
+    length = st.st_size;
+    if (length == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("[Error] mmap trace file failed");
+        exit(1);
+    }
+    madvise(addr, length, MADV_SEQUENTIAL);
+    return (const char*)addr;
+}
+
+// split the text at line boundaries and parse every piece on its own thread
+static vector<TraceChunk> parse_text_parallel(const char* text, size_t length, bool encode) {
+    int thread_num = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    vector<TraceChunk> chunks(thread_num);
+    const char* end = text + length;
+    const char* cur = text;
+    for (int i = 0; i < thread_num; i++) {
+        const char* chunk_end = (i == thread_num - 1) ? end : text + length / thread_num * (i + 1);
+        if (chunk_end < cur) chunk_end = cur;
+        while (chunk_end < end && *chunk_end != '\n') chunk_end++;
+        chunks[i].begin = cur;
+        chunks[i].end = chunk_end;
+        chunks[i].encode = encode;
+        cur = chunk_end;
+    }
+    vector<pthread_t> threads(thread_num);
+    for (int i = 0; i < thread_num; i++) {
+        pthread_create(&threads[i], NULL, parse_trace_chunk, &chunks[i]);
+    }
+    for (int i = 0; i < thread_num; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return chunks;
+}
 
-    char op;
-    char byte_offset[32];
-    traces.reserve(size_t(50 * 1e3 * 1e3)); // 50MB
-    // int line_count = 0;
-    while (fscanf(fp, " %c %s", &op, byte_offset) == 2) { // 2 arg matched
-        // line_count++;
-        // if (line_count % 1000000 == 0){
+void load_trace_file(const char* filename){
+    size_t length;
+    const char* data = map_file(filename, length);
+    if (!data) return;
+
+    if (length >= sizeof(BinaryTraceHeader) && memcmp(data, BINARY_TRACE_MAGIC, 8) == 0) {
+        const BinaryTraceHeader* header = (const BinaryTraceHeader*)data;
+        const uint8_t* payload = (const uint8_t*)data + sizeof(BinaryTraceHeader);
+        // every varint ends with exactly one byte without the continuation bit, so the payload
+        // holds as many complete accesses as such bytes: for_each_trace never decodes past it
+        uint64_t complete = 0;
+        if (sizeof(BinaryTraceHeader) + header->payload_bytes <= length) {
+            for (uint64_t i = 0; i < header->payload_bytes; i++) complete += !(payload[i] & 0x80);
+        }
+        if (sizeof(BinaryTraceHeader) + header->payload_bytes > length || complete < header->item_count) {
+            cerr << "[Error] binary trace is truncated" << endl;
+            exit(1);
+        }
+        binary_trace = payload; // iterate the mapping directly
+        binary_trace_items = header->item_count;
+        return;
+    }
 
-        //     cout << "\rLoaded " << line_count << " / 49000000 line. Complete " << double(line_count) / 49000000 * 100 << "%" << std::flush;
-        // }
-        unsigned long long addr = strtoull(byte_offset, NULL, 16);
-        traces.push_back({(op == 'W'), addr >> 12}); // addr to page number, 4 KB: 2^(2+10)
+    vector<TraceChunk> chunks = parse_text_parallel(data, length, false);
+    size_t total = 0;
+    for (const TraceChunk& chunk : chunks) total += chunk.items.size();
+    traces.reserve(total);
+    for (TraceChunk& chunk : chunks) {
+        traces.insert(traces.end(), chunk.items.begin(), chunk.items.end());
+        vector<TraceItem>().swap(chunk.items);
     }
+    munmap((void*)data, length);
+}
+
+void convert_trace_file(const char* text_filename, const char* binary_filename){
+    size_t length;
+    const char* data = map_file(text_filename, length);
+    vector<TraceChunk> chunks;
+    if (data) chunks = parse_text_parallel(data, length, true);
+
+    FILE* fp = fopen(binary_filename, "wb");
+    if (!fp) {
+        perror("[Error] Open binary trace file failed");
+        exit(1);
+    }
+    BinaryTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_TRACE_MAGIC, 8);
+    fwrite(&header, sizeof(header), 1, fp); // placeholder, rewritten after the payload
+
+    // only the first item of each chunk depends on the previous chunk
+    unsigned long long prev_page = 0;
+    vector<uint8_t> first;
+    for (const TraceChunk& chunk : chunks) {
+        if (chunk.count == 0) continue;
+        first.clear();
+        put_varint(first, encode_item(prev_page, chunk.first_item));
+        fwrite(first.data(), 1, first.size(), fp);
+        fwrite(chunk.encoded.data(), 1, chunk.encoded.size(), fp);
+        header.item_count += chunk.count;
+        header.payload_bytes += first.size() + chunk.encoded.size();
+        prev_page = chunk.last_item.page_number;
+    }
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
     fclose(fp);
+    if (data) munmap((void*)data, length);
+
+    printf("Converted %llu accesses, %llu payload bytes (%.2f bytes/access)\n",
+           (unsigned long long)header.item_count, (unsigned long long)header.payload_bytes,
+           header.item_count ? double(header.payload_bytes) / header.item_count : 0.0);
+}
+
+template <class Policy>
+SimResult run_policy(int frame_size){
+    PageCache<Policy> cache(frame_size);
+    for_each_trace([&](TraceItem trace){
+        cache.access_page(trace);
+    });
+    return cache.stats(frame_size);
+}
+
+const char* policy_names[] = {"LRU", "CFLRU", "CLOCK", "CLOCK-Pro", "2Q", "ARC", "LIRS"};
+
+SimResult page_replacement_sim(int frame_size, string mode = "LRU"){
+
+    if (mode == "LRU") return run_policy<LRUPolicy>(frame_size);
+    else if (mode == "CFLRU") return run_policy<CFLRUPolicy>(frame_size);
+    else if (mode == "CLOCK") return run_policy<CLOCKPolicy>(frame_size);
+    else if (mode == "CLOCK-Pro") return run_policy<CLOCKProPolicy>(frame_size);
+    else if (mode == "2Q") return run_policy<TwoQPolicy>(frame_size);
+    else if (mode == "ARC") return run_policy<ARCPolicy>(frame_size);
+    else if (mode == "LIRS") return run_policy<LIRSPolicy>(frame_size);
+    cerr << "[Error] unknown policy: " << mode << endl;
+    exit(1);
 }
 
-void page_replacement_sim(int frame_size, string mode = "LRU"){
+// ---------------- parallel sweep ----------------
+// every (policy, frame size) configuration only reads the trace, so each one is a task
+// for a pool of worker threads; results are kept in task order for deterministic output
+struct SimTask {
+    string mode;
+    int frame_size;
+    SimResult result;
+};
+
+vector<SimTask> sim_tasks;
+size_t next_sim_task = 0;
+pthread_mutex_t sim_task_mutex = PTHREAD_MUTEX_INITIALIZER;
+Timer sweep_timer;
 
-    if (mode == "LRU"){
-        LRUPageCache cache(frame_size);
-        for (TraceItem trace : traces){
-            cache.access_page(trace);
+void* sim_worker_thread_function(void* arg){
+    while (true) {
+        pthread_mutex_lock(&sim_task_mutex);
+        if (next_sim_task >= sim_tasks.size()) {
+            pthread_mutex_unlock(&sim_task_mutex);
+            break;
         }
-        cache.print_stats(frame_size);
+        SimTask& task = sim_tasks[next_sim_task++];
+        pthread_mutex_unlock(&sim_task_mutex);
+
+        task.result = page_replacement_sim(task.frame_size, task.mode);
+        task.result.finish_sec = sweep_timer.peek();
     }
-    else if (mode == "CFLRU"){
-        CFLRUPageCache cache(frame_size);
-        for (TraceItem trace : traces){
-            cache.access_page(trace);
+    return nullptr;
+}
+
+void run_sim_tasks_parallel(){
+    int thread_num = min<long>(max(1L, sysconf(_SC_NPROCESSORS_ONLN)), sim_tasks.size());
+    next_sim_task = 0;
+    sweep_timer.start();
+    vector<pthread_t> threads(thread_num);
+    for (int i = 0; i < thread_num; i++) {
+        pthread_create(&threads[i], NULL, sim_worker_thread_function, NULL);
+    }
+    for (int i = 0; i < thread_num; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// ---------------- streaming simulation ----------------
+// The trace is never held whole: a reader thread decodes STREAM_BLOCK_ITEMS accesses
+// at a time into a ring of STREAM_RING_SIZE blocks, and every simulation thread feeds
+// each block to its own share of the configurations before the block is recycled.
+// The reader fills the next blocks while the simulators work on the current one, so
+// memory stays at a few blocks plus one read buffer whatever the trace length.
+#define STREAM_BLOCK_ITEMS (1 << 16)
+#define STREAM_RING_SIZE 4
+#define STREAM_READ_BYTES (1 << 20)
+#define MAX_VARINT_BYTES 10
+
+class StreamSim { // one (policy, frame size) configuration, fed block by block
+public:
+    virtual ~StreamSim() {}
+    virtual void feed(const TraceItem* items, size_t count) = 0;
+    virtual SimResult stats() = 0;
+};
+
+template <class Policy>
+class PolicyStreamSim : public StreamSim {
+private:
+    int frame_size;
+    PageCache<Policy> cache;
+public:
+    PolicyStreamSim(int frame_size) : frame_size(frame_size), cache(frame_size) {}
+    void feed(const TraceItem* items, size_t count) override {
+        for (size_t i = 0; i < count; i++) cache.access_page(items[i]);
+    }
+    SimResult stats() override { return cache.stats(frame_size); }
+};
+
+StreamSim* make_stream_sim(const string& mode, int frame_size){
+    if (mode == "LRU") return new PolicyStreamSim<LRUPolicy>(frame_size);
+    else if (mode == "CFLRU") return new PolicyStreamSim<CFLRUPolicy>(frame_size);
+    else if (mode == "CLOCK") return new PolicyStreamSim<CLOCKPolicy>(frame_size);
+    else if (mode == "CLOCK-Pro") return new PolicyStreamSim<CLOCKProPolicy>(frame_size);
+    else if (mode == "2Q") return new PolicyStreamSim<TwoQPolicy>(frame_size);
+    else if (mode == "ARC") return new PolicyStreamSim<ARCPolicy>(frame_size);
+    else if (mode == "LIRS") return new PolicyStreamSim<LIRSPolicy>(frame_size);
+    cerr << "[Error] unknown policy: " << mode << endl;
+    exit(1);
+}
+
+struct StreamBlock {
+    vector<TraceItem> items;
+    size_t count = 0;
+    int readers_left = 0; // simulation threads that have not finished this block, 0: free
+};
+
+struct TraceStream {
+    FILE* input;
+    pid_t decompressor = -1; // child feeding input through a pipe, -1: none
+    StreamBlock ring[STREAM_RING_SIZE];
+    size_t published = 0; // blocks handed to the simulators so far, block k lives in ring[k % STREAM_RING_SIZE]
+    bool finished = false; // reader reached the end of the trace
+    unsigned long long total_items = 0;
+    int consumer_num;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t block_ready = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t block_free = PTHREAD_COND_INITIALIZER;
+};
+
+struct StreamConsumer {
+    TraceStream* stream;
+    vector<StreamSim*> sims;
+    double finish_sec = 0;
+};
+
+// "-" is stdin, *.zst and *.gz are decompressed by zstd / gzip on the fly
+static FILE* open_trace_stream(const char* filename, pid_t& decompressor){
+    decompressor = -1;
+    if (strcmp(filename, "-") == 0) return stdin;
+    size_t len = strlen(filename);
+    const char* program = nullptr;
+    if (len > 4 && strcmp(filename + len - 4, ".zst") == 0) program = "zstd";
+    else if (len > 3 && strcmp(filename + len - 3, ".gz") == 0) program = "gzip";
+    if (!program) {
+        FILE* fp = fopen(filename, "rb");
+        if (!fp) {
+            perror("[Error] Open trace file failed");
+            exit(1);
         }
-        cache.print_stats(frame_size);
+        return fp;
     }
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("[Error] pipe failed");
+        exit(1);
+    }
+    decompressor = fork();
+    if (decompressor < 0) {
+        perror("[Error] fork failed");
+        exit(1);
+    }
+    if (decompressor == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp(program, program, "-dc", "--", filename, (char*)NULL);
+        fprintf(stderr, "[Error] cannot run %s to decompress the trace\n", program);
+        _exit(127);
+    }
+    close(fds[1]);
+    return fdopen(fds[0], "rb");
 }
 
-signed main(int argc, char* argv[]){
-    if (argc != 2){
-        cout << "Only use exactly one argument: <trace_file>." << endl;
-        return 1;
+// wait for the next free slot of the ring, nullptr never happens: the reader owns it until publish
+static StreamBlock* acquire_stream_block(TraceStream* stream){
+    pthread_mutex_lock(&stream->mutex);
+    StreamBlock* block = &stream->ring[stream->published % STREAM_RING_SIZE];
+    while (block->readers_left > 0) pthread_cond_wait(&stream->block_free, &stream->mutex);
+    pthread_mutex_unlock(&stream->mutex);
+    block->count = 0;
+    return block;
+}
+
+static void publish_stream_block(TraceStream* stream, StreamBlock* block){
+    pthread_mutex_lock(&stream->mutex);
+    block->readers_left = stream->consumer_num;
+    stream->published++;
+    stream->total_items += block->count;
+    pthread_cond_broadcast(&stream->block_ready);
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+void* stream_reader_thread_function(void* arg){
+    TraceStream* stream = (TraceStream*)arg;
+    // carry: a partial line (text) or at most one partial varint (binary) from the last read
+    vector<char> buffer(STREAM_READ_BYTES + STREAM_READ_BYTES / 4);
+    size_t filled = 0;
+    bool eof = false;
+    bool binary = false, header_checked = false;
+    uint64_t binary_left = 0;
+    BinaryTraceReader reader(nullptr);
+    StreamBlock* block = acquire_stream_block(stream);
+
+    auto emit = [&](TraceItem item){
+        block->items[block->count++] = item;
+        if (block->count == STREAM_BLOCK_ITEMS) {
+            publish_stream_block(stream, block);
+            block = acquire_stream_block(stream);
+        }
+    };
+
+    while (!eof || filled > 0) {
+        if (!eof) {
+            if (buffer.size() - filled < STREAM_READ_BYTES) buffer.resize(filled + STREAM_READ_BYTES); // a very long line
+            size_t got = fread(buffer.data() + filled, 1, STREAM_READ_BYTES, stream->input);
+            if (got == 0) eof = true;
+            filled += got;
+        }
+        if (!header_checked) {
+            if (filled < sizeof(BinaryTraceHeader) && !eof) continue;
+            header_checked = true;
+            if (filled >= sizeof(BinaryTraceHeader) && memcmp(buffer.data(), BINARY_TRACE_MAGIC, 8) == 0) {
+                BinaryTraceHeader header;
+                memcpy(&header, buffer.data(), sizeof(header));
+                binary = true;
+                binary_left = header.item_count;
+                filled -= sizeof(header);
+                memmove(buffer.data(), buffer.data() + sizeof(header), filled);
+            }
+        }
+
+        const char* begin = buffer.data();
+        const char* end = begin + filled;
+        const char* consumed;
+        if (binary) {
+            // before the end of input only decode varints that cannot run past the buffer
+            const uint8_t* limit = (const uint8_t*)(eof ? end : max(begin, end - MAX_VARINT_BYTES));
+            reader.set_position((const uint8_t*)begin);
+            while (binary_left > 0 && reader.position() < limit && (!eof || reader.has_next((const uint8_t*)end))) {
+                emit(reader.next());
+                binary_left--;
+            }
+            if (eof && binary_left > 0) { // the header promised more, drop the partial varint
+                cerr << "[Error] binary trace is truncated, the last " << binary_left << " accesses are missing" << endl;
+                binary_left = 0;
+            }
+            consumed = (const char*)reader.position();
+            if (binary_left == 0 || eof) consumed = end; // trailing bytes after the last access are ignored
+        } else {
+            // parse up to the last complete line, the rest waits for the next read
+            const char* stop = end;
+            if (!eof) {
+                while (stop > begin && stop[-1] != '\n') stop--;
+            }
+            const char* p = begin;
+            TraceItem item;
+            while (parse_trace_line(p, stop, item)) emit(item);
+            consumed = stop;
+        }
+        filled = end - consumed;
+        memmove(buffer.data(), consumed, filled);
+        if (eof && !binary && filled > 0) filled = 0; // nothing left that forms a line
+        if (binary && binary_left == 0) break;
+    }
+    if (block->count > 0) publish_stream_block(stream, block);
+
+    pthread_mutex_lock(&stream->mutex);
+    stream->finished = true;
+    pthread_cond_broadcast(&stream->block_ready);
+    pthread_mutex_unlock(&stream->mutex);
+    return nullptr;
+}
+
+void* stream_consumer_thread_function(void* arg){
+    StreamConsumer* consumer = (StreamConsumer*)arg;
+    TraceStream* stream = consumer->stream;
+    for (size_t next = 0;; next++) {
+        pthread_mutex_lock(&stream->mutex);
+        while (stream->published <= next && !stream->finished) {
+            pthread_cond_wait(&stream->block_ready, &stream->mutex);
+        }
+        if (stream->published <= next) { // finished and nothing new
+            pthread_mutex_unlock(&stream->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&stream->mutex);
+
+        // the block cannot be recycled before this thread gives it back, no lock needed to read it
+        StreamBlock& block = stream->ring[next % STREAM_RING_SIZE];
+        for (StreamSim* sim : consumer->sims) sim->feed(block.items.data(), block.count);
+
+        pthread_mutex_lock(&stream->mutex);
+        if (--block.readers_left == 0) pthread_cond_signal(&stream->block_free);
+        pthread_mutex_unlock(&stream->mutex);
+    }
+    consumer->finish_sec = sweep_timer.peek();
+    return nullptr;
+}
+
+// same results as run_sim_tasks_parallel, but reads the trace once while simulating
+void run_sim_tasks_stream(const char* filename){
+    TraceStream stream;
+    stream.input = open_trace_stream(filename, stream.decompressor);
+    for (StreamBlock& block : stream.ring) block.items.resize(STREAM_BLOCK_ITEMS);
+
+    // the reader is one more thread, every simulation thread sees every block
+    int thread_num = min<long>(max(1L, sysconf(_SC_NPROCESSORS_ONLN)), sim_tasks.size());
+    stream.consumer_num = thread_num;
+    vector<StreamConsumer> consumers(thread_num);
+    vector<StreamSim*> sims;
+    for (size_t i = 0; i < sim_tasks.size(); i++) {
+        sims.push_back(make_stream_sim(sim_tasks[i].mode, sim_tasks[i].frame_size));
+        consumers[i % thread_num].sims.push_back(sims.back());
+    }
+
+    sweep_timer.start();
+    pthread_t reader_thread;
+    vector<pthread_t> threads(thread_num);
+    pthread_create(&reader_thread, NULL, stream_reader_thread_function, &stream);
+    for (int i = 0; i < thread_num; i++) {
+        consumers[i].stream = &stream;
+        pthread_create(&threads[i], NULL, stream_consumer_thread_function, &consumers[i]);
+    }
+    pthread_join(reader_thread, NULL);
+    for (int i = 0; i < thread_num; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < sim_tasks.size(); i++) {
+        sim_tasks[i].result = sims[i]->stats();
+        sim_tasks[i].result.finish_sec = consumers[i % thread_num].finish_sec;
+        delete sims[i];
+    }
+    if (stream.input != stdin) fclose(stream.input);
+    if (stream.decompressor > 0) {
+        int status;
+        waitpid(stream.decompressor, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cerr << "[Error] decompressing " << filename << " failed" << endl;
+            exit(1);
+        }
+    }
+}
+
+// ---------------- single pass LRU (Mattson stack distance) ----------------
+// LRU has the inclusion property: a page hits in a cache of C frames iff its
+// stack distance (distinct pages touched since its last access, itself included) <= C.
+// A Fenwick tree over access time with a 1 at every page's latest access gives
+// that distance in O(log n), so one pass yields hit/miss for every capacity.
+//
+// Write back: a dirty page is written back when the gap before its next access
+// (or the trace end) evicts it. For a page written at some point, let M be the
+// largest distance seen since that write; a gap of distance d then writes back
+// in every capacity C with M <= C < d, and afterwards M = max(M, d).
+#define NO_PENDING_WRITE 0xffffffffu
+
+class StackDistanceLRU {
+private:
+    struct Entry {
+        unsigned long long page_number;
+        uint32_t last_time; // position in the Fenwick tree, NIL_INDEX: empty slot
+        uint32_t pending_max; // M above, NO_PENDING_WRITE if the page is clean for every capacity
+    };
+    vector<Entry> table; // open addressing, linear probing
+    uint64_t table_mask = 0;
+    uint64_t distinct = 0;
+    vector<int> fenwick;
+    uint32_t now = 0;
+    vector<long long> distance_count; // distance_count[d]: hits in every cache with >= d frames
+    vector<long long> write_back_diff; // difference array over capacity
+    long long cold_miss = 0;
+    long long total = 0;
+
+    inline void fenwick_add(uint32_t pos, int value) {
+        for (uint32_t i = pos + 1; i < fenwick.size(); i += i & (-i)) fenwick[i] += value;
+    }
+    inline long long fenwick_prefix(uint32_t pos) { // sum of [0, pos]
+        long long sum = 0;
+        for (uint32_t i = pos + 1; i > 0; i -= i & (-i)) sum += fenwick[i];
+        return sum;
+    }
+    inline uint64_t hash_func(unsigned long long key) {
+        key *= 0x9E3779B97F4A7C15ull;
+        return key ^ (key >> 32);
+    }
+    Entry& find_or_insert(unsigned long long page_number) {
+        if ((distinct + 1) * 2 > table.size()) grow_table();
+        uint64_t idx = hash_func(page_number) & table_mask;
+        while (table[idx].last_time != NIL_INDEX) {
+            if (table[idx].page_number == page_number) return table[idx];
+            idx = (idx + 1) & table_mask;
+        }
+        distinct++;
+        table[idx] = {page_number, NIL_INDEX, NO_PENDING_WRITE};
+        return table[idx];
+    }
+    void grow_table() {
+        vector<Entry> old;
+        old.swap(table);
+        table.assign(max<size_t>(old.size() * 2, 1 << 16), {0, NIL_INDEX, NO_PENDING_WRITE});
+        table_mask = table.size() - 1;
+        for (const Entry& e : old) {
+            if (e.last_time == NIL_INDEX) continue;
+            uint64_t idx = hash_func(e.page_number) & table_mask;
+            while (table[idx].last_time != NIL_INDEX) idx = (idx + 1) & table_mask;
+            table[idx] = e;
+        }
+    }
+    // time runs out of Fenwick slots: renumber the live pages 0..distinct-1 by their last access
+    void compact() {
+        vector<pair<uint32_t, uint64_t>> order; // (last_time, slot)
+        order.reserve(distinct);
+        for (uint64_t i = 0; i < table.size(); i++) {
+            if (table[i].last_time != NIL_INDEX) order.push_back({table[i].last_time, i});
+        }
+        sort(order.begin(), order.end());
+        for (uint32_t t = 0; t < order.size(); t++) table[order[t].second].last_time = t;
+        now = order.size();
+        size_t slots = max<size_t>(fenwick.size() - 1, order.size() * 2);
+        fenwick.assign(slots + 1, 0);
+        for (uint32_t i = 1; i < fenwick.size(); i++) { // O(n) build, positions [0, now) hold a 1
+            if (i <= now) fenwick[i] += 1;
+            uint32_t parent = i + (i & (-i));
+            if (parent < fenwick.size()) fenwick[parent] += fenwick[i];
+        }
+    }
+    inline void add_write_back(uint32_t from, uint64_t to) { // capacities [from, to)
+        if (from >= to) return;
+        if (write_back_diff.size() <= to) write_back_diff.resize(to + 1, 0);
+        write_back_diff[from]++;
+        write_back_diff[to]--;
+    }
+public:
+    StackDistanceLRU() {
+        fenwick.assign((1 << 20) + 1, 0);
+        grow_table();
+    }
+    void access_page(TraceItem trace) {
+        total++;
+        if (now + 1 >= fenwick.size()) compact();
+        Entry& entry = find_or_insert(trace.page_number);
+        if (entry.last_time == NIL_INDEX) {
+            cold_miss++;
+        } else {
+            uint64_t distance = distinct - fenwick_prefix(entry.last_time) + 1; // marks after the last access, plus the page itself
+            if (distance_count.size() <= distance) distance_count.resize(max<size_t>(distance + 1, distance_count.size() * 2), 0);
+            distance_count[distance]++;
+            if (entry.pending_max != NO_PENDING_WRITE) {
+                add_write_back(entry.pending_max, distance);
+                entry.pending_max = max<uint64_t>(entry.pending_max, distance);
+            }
+            fenwick_add(entry.last_time, -1);
+        }
+        if (trace.is_write) entry.pending_max = 0;
+        entry.last_time = now;
+        fenwick_add(now, 1);
+        now++;
+    }
+    // pages still dirty at the end were evicted in every cache smaller than their final depth
+    void finish() {
+        for (const Entry& e : table) {
+            if (e.last_time == NIL_INDEX || e.pending_max == NO_PENDING_WRITE) continue;
+            uint64_t pages_after = distinct - fenwick_prefix(e.last_time);
+            add_write_back(e.pending_max, pages_after + 1);
+        }
     }
-    // cout << "load trace file: " << argv[1] << endl;
-    load_trace_file(argv[1]);
-    // cout << endl;
+    // miss[C] and write_back[C] for C in [0, max_capacity]
+    void curve(uint64_t max_capacity, vector<long long>& miss, vector<long long>& write_back) {
+        miss.assign(max_capacity + 1, 0);
+        write_back.assign(max_capacity + 1, 0);
+        long long hits = 0, wb = 0;
+        for (uint64_t c = 0; c <= max_capacity; c++) {
+            if (c < distance_count.size()) hits += distance_count[c];
+            if (c < write_back_diff.size()) wb += write_back_diff[c];
+            miss[c] = total - hits;
+            write_back[c] = wb;
+        }
+    }
+    uint64_t distinct_pages() { return distinct; }
+    long long accesses() { return total; }
+};
 
-    // cout << "initialize timer and start testing..." << endl;
+void stack_distance_sim(const char* mrc_filename){
+    StackDistanceLRU sim;
+    for_each_trace([&](TraceItem trace){
+        sim.access_page(trace);
+    });
+    sim.finish();
+
+    uint64_t max_capacity = sim.distinct_pages();
+    for (int frame_size : frame_sizes) max_capacity = max<uint64_t>(max_capacity, frame_size);
+    vector<long long> miss, write_back;
+    sim.curve(max_capacity, miss, write_back);
+
+    long long total = sim.accesses();
+    for (int frame_size : frame_sizes) {
+        print_result({frame_size, total - miss[frame_size], miss[frame_size], write_back[frame_size]});
+    }
+
+    if (mrc_filename) {
+        FILE* fp = fopen(mrc_filename, "w");
+        if (!fp) {
+            perror("[Error] Open miss ratio curve file failed");
+            return;
+        }
+        // only the capacities where the curve steps, beyond the last row nothing changes
+        fprintf(fp, "frames,miss,miss_ratio,write_back\n");
+        for (uint64_t c = 1; c <= max_capacity; c++) {
+            if (c == 1 || miss[c] != miss[c - 1] || write_back[c] != write_back[c - 1]) {
+                fprintf(fp, "%llu,%lld,%.10f,%lld\n", (unsigned long long)c, miss[c],
+                        total ? (double)miss[c] / total : 0.0, write_back[c]);
+            }
+        }
+        fclose(fp);
+    }
+}
+
+// ---------------- page table benchmark ----------------
+// lookup / insert / delete throughput of the Swiss table against the old chained
+// table, on a pool shaped like a full cache (a delete + insert per miss)
+static inline unsigned long long bench_random(unsigned long long& state) { // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template <class Table>
+void bench_page_table(const char* name, int nodes, int operations){
+    vector<PageMeta> pool(nodes);
+    unsigned long long state = 0x2545F4914F6CDD1Dull;
+    vector<unsigned long long> pages(nodes), hit_keys(operations), miss_keys(operations), new_pages(operations);
+    vector<uint32_t> victims(operations);
+    for (int i = 0; i < nodes; i++) pages[i] = bench_random(state) >> 24; // 40 bit page numbers
+    for (int i = 0; i < operations; i++) {
+        hit_keys[i] = pages[bench_random(state) % nodes];
+        miss_keys[i] = (bench_random(state) >> 24) | (1ull << 41); // never inserted
+        victims[i] = bench_random(state) % nodes;
+        new_pages[i] = (bench_random(state) >> 24) | (1ull << 42);
+    }
+    Table table;
+    table.init(nodes, pool.data());
     Timer timer;
-    timer.start();
+    volatile uint32_t sink = 0;
 
-    cout<< "LRU policy:" << endl;
-    printf("Frame\tHit\t\tMiss\t\tPage fault ratio\tWrite back count\n");
-    for(int frame_size : frame_sizes){
-        page_replacement_sim(frame_size, "LRU");
+    timer.start();
+    for (int i = 0; i < nodes; i++) {
+        pool[i].initialize(pages[i]);
+        table.put(i);
     }
+    double insert_sec = timer.stop();
 
-    double elapsed = timer.stop();
-    cout << fixed << setprecision(6) << "Elapsed time: " << elapsed << " sec" << endl;
+    timer.start();
+    for (int i = 0; i < operations; i++) sink = sink + table.get(hit_keys[i]);
+    double hit_sec = timer.stop();
 
-    timer.clear();
-    cout << endl;
     timer.start();
+    for (int i = 0; i < operations; i++) sink = sink + table.get(miss_keys[i]);
+    double miss_sec = timer.stop();
 
-    cout<< "CFLRU policy:" << endl;
-    printf("Frame\tHit\t\tMiss\t\tPage fault ratio\tWrite back count\n");
-    for(int frame_size : frame_sizes){
-        page_replacement_sim(frame_size, "CFLRU");
+    timer.start();
+    for (int i = 0; i < operations; i++) { // same as a cache miss: lookup fails, evict a page, load the new one into its node
+        uint32_t node = victims[i];
+        sink = sink + table.get(new_pages[i] + i);
+        table.remove(node);
+        pool[node].page_number = new_pages[i] + i;
+        table.put(node);
     }
+    double churn_sec = timer.stop();
 
-    elapsed = timer.stop();
-    cout << fixed << setprecision(6) << "Elapsed time: " << elapsed << " sec" << endl;
-
+    printf("%s\t%d\t%.1f\t\t%.1f\t\t%.1f\t\t%.1f\n", name, nodes,
+           nodes / insert_sec / 1e6, operations / hit_sec / 1e6, operations / miss_sec / 1e6, operations / churn_sec / 1e6);
 }
 
+void bench_page_tables(){
+    const int operations = 10000000;
+    printf("Table\tNodes\tInsert(M/s)\tHit get(M/s)\tMiss get(M/s)\tMiss+evict+insert(M/s)\n");
+    for (int frame_size : frame_sizes) {
+        bench_page_table<SimpleHashTable>("chain", frame_size, operations);
+        bench_page_table<SwissPageTable>("swiss", frame_size, operations);
+    }
+    for (int nodes : {1 << 20, 1 << 23}) { // beyond the last level cache
+        bench_page_table<SimpleHashTable>("chain", nodes, operations);
+        bench_page_table<SwissPageTable>("swiss", nodes, operations);
+    }
+}
 
+signed main(int argc, char* argv[]){
+    if (argc == 4 && strcmp(argv[1], "--convert") == 0){
+        convert_trace_file(argv[2], argv[3]);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "--bench-table") == 0){
+        bench_page_tables();
+        return 0;
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--stack-distance") == 0){
+        load_trace_file(argv[2]);
+        Timer timer;
+        timer.start();
+        cout<< "LRU policy (single pass stack distance):" << endl;
+        printf("Frame\tHit\t\tMiss\t\tPage fault ratio\tWrite back count\n");
+        stack_distance_sim(argc == 4 ? argv[3] : nullptr);
+        cout << fixed << setprecision(6) << "Elapsed time: " << timer.stop() << " sec" << endl;
+        return 0;
+    }
+    // --policies LRU,ARC,... or --policies all picks the policies to compare, default is LRU and CFLRU
+    // --stream reads the trace (file, - for stdin, *.zst, *.gz) block by block instead of loading it
+    vector<string> modes = {"LRU", "CFLRU"};
+    bool stream = false;
+    if (argc == 4 && (strcmp(argv[1], "--policies") == 0 || strcmp(argv[1], "--stream") == 0)){
+        stream = strcmp(argv[1], "--stream") == 0;
+        modes.clear();
+        string list = argv[2];
+        if (list == "all") list = "LRU,CFLRU,CLOCK,CLOCK-Pro,2Q,ARC,LIRS";
+        stringstream ss(list);
+        string name;
+        while (getline(ss, name, ',')) {
+            bool known = false;
+            for (const char* policy : policy_names) known |= (name == policy);
+            if (!known) {
+                cerr << "[Error] unknown policy: " << name << endl;
+                return 1;
+            }
+            if (find(modes.begin(), modes.end(), name) == modes.end()) modes.push_back(name); // a repeat runs once
+        }
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 2){
+        cout << "Only use exactly one argument: <trace_file>." << endl;
+        cout << "Or convert a text trace to the binary format: --convert <text_trace> <binary_trace>" << endl;
+        cout << "Or simulate LRU for every frame size in one pass: --stack-distance <trace_file> [miss_ratio_curve.csv]" << endl;
+        cout << "Or compare other policies: --policies <LRU,CFLRU,CLOCK,CLOCK-Pro,2Q,ARC,LIRS|all> <trace_file>" << endl;
+        cout << "Or stream the trace with bounded memory: --stream <LRU,CFLRU,...|all> <trace_file|-|trace.zst|trace.gz>" << endl;
+        cout << "Or benchmark the page table: --bench-table" << endl;
+        return 1;
+    }
+    // all configurations run at the same time, the elapsed time of a policy is
+    // the wall time until its last frame size finishes
+    for (const string& mode : modes) {
+        for (int frame_size : frame_sizes) {
+            sim_tasks.push_back({mode, frame_size, {}});
+        }
+    }
+    if (stream) {
+        run_sim_tasks_stream(argv[1]);
+    } else {
+        // cout << "load trace file: " << argv[1] << endl;
+        load_trace_file(argv[1]);
+        // cout << endl;
+        run_sim_tasks_parallel();
+    }
 
+    bool first = true;
+    for (const string& mode : modes) {
+        if (!first) cout << endl;
+        first = false;
+        cout<< mode << " policy:" << endl;
+        printf("Frame\tHit\t\tMiss\t\tPage fault ratio\tWrite back count\n");
+        double elapsed = 0;
+        for (const SimTask& task : sim_tasks) {
+            if (task.mode != mode) continue;
+            print_result(task.result);
+            elapsed = max(elapsed, task.result.finish_sec);
+        }
+        cout << fixed << setprecision(6) << "Elapsed time: " << elapsed << " sec" << endl;
+    }
 
+}
\ No newline at end of file
@@ -1,6 +1,6 @@
 #define _FILE_OFFSET_BITS 64
 #define FUSE_USE_VERSION 30
-#include <fuse.h>
+#include <fuse_lowlevel.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,11 +8,29 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <zlib.h>
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define TARFS_ZSTD // .tar.zst support, needs -lzstd
+#endif
 #include <vector>
 #include <string>
 #include <sstream>
 #include <algorithm>
 #include <iostream>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
@@ -37,120 +55,278 @@ struct PosixHeader {
     char padding[12];
 };
 
-class FileNode{ // store file arichtecture as a tree
-public:
-    char name[256];
-    size_t size;
-    int mode; // mode include file type and permission
-    int type;
-    uid_t uid; 
-    gid_t gid;
-    time_t mtime;
-    size_t offset;
-    char link_target[256];
-    vector<FileNode*> childs;
-
-    FileNode(){
-        memset(name, 0, sizeof(name));
-        size = 0;
-        mode = 0;
-        type = 0;
-        offset = 0;
-        memset(link_target, 0, sizeof(link_target));
-        childs.clear();
-    }
-
-    static vector<string> split_path(const char* path) {
-        vector<string> result;
-        stringstream ss(path);
-        string item;
-        while (getline(ss, item, '/')) {
-            if (!item.empty()) result.push_back(item);
-        }
-        return result;
-    }
-
-    // input the relative path take this node as root
-    // ex: for node / , input "dir1/file.txt"
-    // ex: for node /dir1, input "file.txt" or "dir2/file2.txt"
-    FileNode* find_node(const char* path) {
-        if (!path || strcmp(path, "/") == 0 || strcmp(path, "") == 0) {
-            return this;
-        }
-
-        vector<string> parts = split_path(path);
-
-        FileNode* curr = this;
-
-        for (const string& part : parts) {
-            FileNode* found = NULL;
-            for (auto child : curr->childs) {
-                if (strcmp(child->name, part.c_str()) == 0) {
-                    found = child;
-                    break;
-                }
-            }
+// FNV-1a, incremental so a path hash is its parent's hash continued with "/name"
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static inline uint64_t fnv_update(uint64_t hash, const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char)data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+#define NIL_NODE 0xffffffffu
+#define ROOT_NODE 0
+#define NODE_IMPLICIT 0x1 // directory only seen as part of a path so far, its own header may come later
+#define NODE_SPARSE 0x2 // content is an extent map, everything between the extents reads as zeros
+
+// one archive member in 56 bytes, flat and pointer free: links are node indices and strings
+// are offsets in the string pool, so the same bytes work in memory and in the sidecar index
+struct FileNode {
+    uint64_t path_hash; // key in the path index
+    uint64_t size;
+    uint64_t offset; // content offset in the archive, symlinks: string pool offset of the target
+    int64_t mtime;
+    uint32_t name; // string pool offset
+    uint32_t owner : 24; // (uid, gid) in owners
+    uint32_t flags : 8;
+    uint32_t parent;
+    uint32_t first; // directories: children are child_index[first, first + count)
+    uint32_t count; // sparse files: extents are sparse_extents[first, first + count)
+    uint16_t mode; // mode include file type and permission
+    uint16_t nlink; // set by finish_tar_index, 1 until then (and for directories too big to count, like ext4)
+};
+
+struct Owner {
+    uint32_t uid;
+    uint32_t gid;
+};
+
+// a stored run of a sparse member: file bytes [logical, logical + length) are at physical in the archive
+struct SparseExtent {
+    uint64_t logical;
+    uint64_t length;
+    uint64_t physical;
+};
+
+// The index is a few flat arrays: nodes (root first), the string pool (NUL terminated, offset 0
+// is "", names and link targets interned so a name repeated in many directories is stored once),
+// owners, the path index (open addressing over path_hash, one node index per slot, NIL_NODE:
+// empty) and child_index, every directory's children next to each other in archive (readdir)
+// order. While the archive is scanned they live in the vectors below, a sidecar index file is
+// mapped and used in place. They grow while the archive is indexed in the background (see
+// IndexGuard) and child_index is only built at the end (finish_tar_index), which is fine since
+// readdir waits for a complete index anyway. Once indexing is done nothing changes again and
+// callbacks read them without locks.
+FileNode* nodes = NULL;
+uint32_t node_count = 0;
+const char* string_pool = NULL;
+const Owner* owners = NULL;
+uint32_t* path_slots = NULL;
+uint32_t path_mask = 0; // slot count - 1
+const uint32_t* child_index = NULL;
+const SparseExtent* sparse_extents = NULL;
+
+vector<FileNode> node_store;
+vector<char> string_store;
+vector<Owner> owner_store;
+vector<uint32_t> slot_store;
+vector<uint32_t> child_store;
+vector<SparseExtent> extent_store;
+// only while scanning: string pool offsets by content, owners by (uid << 32 | gid)
+vector<uint32_t> string_slots;
+size_t string_slot_count = 0;
+unordered_map<uint64_t, uint32_t> owner_map;
+vector<uint64_t> hardlink_offsets; // content offsets shared by hard links
+
+static inline const char* node_name(uint32_t index) {
+    return string_pool + nodes[index].name;
+}
+
+static inline uint32_t node_type(uint32_t index) {
+    return nodes[index].mode & S_IFMT;
+}
 
-            if (!found) return NULL; // no such node in subtree which root is curr
+uint32_t append_string(const char* str, size_t len) {
+    uint32_t offset = string_store.size();
+    string_store.insert(string_store.end(), str, str + len);
+    string_store.push_back('\0');
+    string_pool = string_store.data();
+    return offset;
+}
 
-            curr = found;
+// same content, same offset: open addressing over the FNV hash of the string, 0 is an empty
+// slot (offset 0 is "" and always the first string)
+uint32_t add_string(const char* str, size_t len) {
+    if (len == 0) return 0;
+    uint64_t hash = fnv_update(FNV_OFFSET_BASIS, str, len);
+    size_t mask = string_slots.size() - 1;
+    size_t i = hash & mask;
+    for (; string_slots[i] != 0; i = (i + 1) & mask) {
+        const char* candidate = string_pool + string_slots[i];
+        if (strncmp(candidate, str, len) == 0 && candidate[len] == '\0') return string_slots[i];
+    }
+    uint32_t offset = append_string(str, len);
+    string_slots[i] = offset;
+    if (++string_slot_count * 4 > string_slots.size() * 3) { // load <= 3/4, rebuild bigger
+        vector<uint32_t> old_slots;
+        old_slots.swap(string_slots);
+        string_slots.assign(old_slots.size() * 2, 0);
+        mask = string_slots.size() - 1;
+        for (uint32_t old : old_slots) {
+            if (old == 0) continue;
+            const char* p = string_pool + old;
+            size_t j = fnv_update(FNV_OFFSET_BASIS, p, strlen(p)) & mask;
+            while (string_slots[j] != 0) j = (j + 1) & mask;
+            string_slots[j] = old;
         }
+    }
+    return offset;
+}
 
-        return curr;
+uint32_t add_owner(uint32_t uid, uint32_t gid) {
+    uint64_t key = (uint64_t)uid << 32 | gid;
+    auto found = owner_map.find(key);
+    if (found != owner_map.end()) return found->second;
+    if (owner_store.size() >= (1u << 24)) return 0; // FileNode::owner is 24 bits
+    uint32_t index = owner_store.size();
+    owner_store.push_back({uid, gid});
+    owners = owner_store.data();
+    owner_map[key] = index;
+    return index;
+}
+
+// match tells nodes with the same path hash apart
+template <class Match>
+uint32_t find_path_slot(uint64_t hash, Match match) {
+    if (!path_slots) return NIL_NODE;
+    for (uint32_t i = hash & path_mask; path_slots[i] != NIL_NODE; i = (i + 1) & path_mask) {
+        uint32_t index = path_slots[i];
+        if (nodes[index].path_hash == hash && match(index)) return index;
     }
+    return NIL_NODE;
+}
 
-    void print_tree(int depth = 0) {
-        for (int i = 0; i < depth; ++i) {
-            cout << "  ";
-        }
-        cout << name << " (size: " << size << ", mode: " << oct << mode << dec << ")\n";
-        for (auto child : childs) {
-            child->print_tree(depth + 1);
+void place_path_slot(uint32_t index) {
+    uint32_t i = nodes[index].path_hash & path_mask;
+    while (path_slots[i] != NIL_NODE) i = (i + 1) & path_mask;
+    path_slots[i] = index;
+}
+
+void insert_path_slot(uint32_t index) {
+    if ((uint64_t)node_count * 4 > (uint64_t)slot_store.size() * 3) { // load <= 3/4, rebuild bigger
+        slot_store.assign(slot_store.empty() ? 16 : slot_store.size() * 2, NIL_NODE);
+        path_slots = slot_store.data();
+        path_mask = slot_store.size() - 1;
+        for (uint32_t i = 0; i < node_count; ++i) place_path_slot(i); // index included
+        return;
+    }
+    place_path_slot(index);
+}
+
+// new node at the end of parent's children (parent NIL_NODE: the root)
+uint32_t add_node(uint32_t parent, const char* name, size_t len) {
+    FileNode node;
+    memset(&node, 0, sizeof(node));
+    node.name = add_string(name, len);
+    node.parent = parent;
+    node.nlink = 1;
+    node.path_hash = (parent == NIL_NODE) ? FNV_OFFSET_BASIS
+                                          : fnv_update(fnv_update(nodes[parent].path_hash, "/", 1), name, len);
+    uint32_t index = node_store.size();
+    node_store.push_back(node);
+    nodes = node_store.data();
+    node_count = node_store.size();
+    insert_path_slot(index);
+    return index;
+}
+
+uint32_t find_child(uint32_t parent, const char* name, size_t len) {
+    uint64_t hash = fnv_update(fnv_update(nodes[parent].path_hash, "/", 1), name, len);
+    return find_path_slot(hash, [&](uint32_t index) {
+        const char* child_name = node_name(index);
+        return nodes[index].parent == parent && strncmp(child_name, name, len) == 0 && child_name[len] == '\0';
+    });
+}
+
+// does node sit exactly at path? compare the components from the end up the parent chain
+bool node_matches_path(uint32_t index, const char* path, size_t len) {
+    while (len > 0 && path[len - 1] == '/') len--;
+    while (index != ROOT_NODE) {
+        size_t start = len;
+        while (start > 0 && path[start - 1] != '/') start--;
+        size_t name_len = len - start;
+        const char* name = node_name(index);
+        if (name_len == 0 || strncmp(name, path + start, name_len) != 0 || name[name_len] != '\0') {
+            return false;
         }
+        len = start;
+        while (len > 0 && path[len - 1] == '/') len--;
+        index = nodes[index].parent;
     }
+    return len == 0;
+}
 
-};
-FileNode* root = new FileNode(); // file architecture tree root
+// O(path length) and no allocation, used to resolve hard link targets
+// key: fnv of "/a/b/c" (empty for root), repeated and trailing '/' are ignored
+uint32_t lookup_path(const char* path) {
+    if (!path) return NIL_NODE;
+    uint64_t hash = FNV_OFFSET_BASIS;
+    const char* p = path;
+    while (*p) {
+        while (*p == '/') p++;
+        const char* part = p;
+        while (*p && *p != '/') p++;
+        if (p == part) break;
+        hash = fnv_update(fnv_update(hash, "/", 1), part, p - part);
+    }
+    size_t len = p - path;
+    return find_path_slot(hash, [&](uint32_t index) { return node_matches_path(index, path, len); });
+}
 
-int octal_to_int(char *oct) {
-    return strtol(oct, NULL, 8);
+void print_tree(uint32_t index, int depth = 0) {
+    for (int i = 0; i < depth; ++i) {
+        cout << "  ";
+    }
+    cout << node_name(index) << " (size: " << nodes[index].size << ", mode: " << oct << nodes[index].mode << dec << ")\n";
+    if (node_type(index) != S_IFDIR) return;
+    for (uint32_t i = 0; i < nodes[index].count; ++i) {
+        print_tree(child_index[nodes[index].first + i], depth + 1);
+    }
 }
 
-// "dir1/file.txt" -> ["dir1", "file.txt"])
+// numeric header field: octal (space / NUL padded) or, when the first byte has its high bit
+// set, GNU base-256 (big endian, 0xff marks a negative number) for values octal cannot hold
+int64_t parse_tar_number(const char* field, size_t len) {
+    const unsigned char* p = (const unsigned char*)field;
+    if (p[0] & 0x80) {
+        uint64_t value = (p[0] == 0xff) ? ~0ull : (p[0] & 0x7f);
+        for (size_t i = 1; i < len; ++i) value = (value << 8) | p[i];
+        return (int64_t)value;
+    }
+    size_t i = 0;
+    while (i < len && p[i] == ' ') i++;
+    uint64_t value = 0;
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i) value = (value << 3) | (p[i] - '0');
+    return (int64_t)value;
+}
+
+// "dir1/file.txt" -> ["dir1", "file.txt"]), "." components ("./dir1/") are dropped
 vector<string> split_path(const char* path) {
     vector<string> result;
     stringstream ss(path);
     string item;
     while (getline(ss, item, '/')) {
-        if (!item.empty()) result.push_back(item);
+        if (!item.empty() && item != ".") result.push_back(item);
     }
     return result;
 }
 
-FileNode* get_parent_node(FileNode* root, const char* path) {
-    vector<string> path_parts = split_path(path);
-    FileNode* curr = root;
+uint32_t get_parent_node(const vector<string>& path_parts) {
+    uint32_t curr = ROOT_NODE;
 
     for (size_t i = 0; i < path_parts.size() - 1; ++i) {
         string part = path_parts[i];
         
-        FileNode* found = NULL;
-        for (auto child : curr->childs) {
-            if (strcmp(child->name, part.c_str()) == 0) {
-                found = child;
-                break;
-            }
-        }
+        uint32_t found = find_child(curr, part.c_str(), part.size());
 
         // some inter nodes haven't been created yet
-        if (!found) { // create a defalut dir node for it
-            found = new FileNode();
-            strcpy(found->name, part.c_str());
-            found->type = S_IFDIR;
-            found->mode = S_IFDIR | 0755; // default permission
-            found->uid = getuid();
-            found->gid = getgid();
-            curr->childs.push_back(found);
+        if (found == NIL_NODE) { // create a defalut dir node for it
+            found = add_node(curr, part.c_str(), part.size());
+            nodes[found].mode = S_IFDIR | 0755; // default permission
+            nodes[found].owner = add_owner(getuid(), getgid());
+            nodes[found].flags = NODE_IMPLICIT;
         }
         
         curr = found;
@@ -158,199 +334,1856 @@ FileNode* get_parent_node(FileNode* root, const char* path) {
     return curr;
 }
 
-void parse_tar_file(){
+// the archive stays open for the whole mount, reads copy from the mapping (or pread when it cannot be mapped)
+int tar_fd = -1;
+const char* tar_map = NULL;
+size_t tar_map_size = 0;
+struct stat tar_stat;
 
-    FILE *fp = fopen(tar_filename, "rb");
-    if (!fp) {
+// ---------------- block cache ----------------
+// A plain archive that could be mapped is read straight from the mapping, the page cache already
+// holds it (readahead: madvise). Otherwise file contents are read in CACHE_BLOCK pieces keyed by
+// tar stream offset / CACHE_BLOCK. A block comes from pread or a decoder (compressed archives)
+// and stays in a CLOCK cache of
+// at most cache_blocks blocks (--cache-mb). Blocks being loaded are marked, so a read that
+// catches up with readahead waits for the block instead of loading it a second time.
+#define CACHE_BLOCK (128 * 1024)
+#define CACHE_DEFAULT_MB 64
+
+// a block's bytes, not zeroed first: the load writes them and shrinks size to what it got
+struct BlockBuffer {
+    unique_ptr<char[]> bytes;
+    size_t length;
+    BlockBuffer(size_t capacity) : bytes(new char[capacity]), length(capacity) {}
+    char* data() { return bytes.get(); }
+    const char* data() const { return bytes.get(); }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    void resize(size_t n) { length = min(n, length); }
+};
+
+typedef shared_ptr<const BlockBuffer> ArchiveBlock; // shared: eviction never frees a block still being copied
+
+struct CacheSlot {
+    uint64_t number;
+    ArchiveBlock data;
+    bool referenced; // CLOCK bit, set on load and on every hit
+};
+
+pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cache_loaded = PTHREAD_COND_INITIALIZER;
+vector<CacheSlot> cache_slots;
+unordered_map<uint64_t, uint32_t> cache_map; // block number -> slot
+unordered_set<uint64_t> cache_loading;
+size_t cache_hand = 0;
+size_t cache_blocks = (size_t)CACHE_DEFAULT_MB * 1024 * 1024 / CACHE_BLOCK;
+bool print_cache_stats = false; // --cache-stats: print the statistics (format_stats) at unmount
+
+atomic<uint64_t> cache_hits(0), cache_misses(0), cache_prefetched(0), cache_evicted(0);
+
+// caller holds cache_mutex
+void cache_insert(uint64_t number, const ArchiveBlock& data) {
+    if (cache_map.count(number)) return; // loaded by another thread meanwhile
+    if (cache_slots.size() < cache_blocks) {
+        cache_map[number] = cache_slots.size();
+        cache_slots.push_back({number, data, true});
+        return;
+    }
+    // second chance: referenced slots lose their bit and are passed over
+    while (cache_slots[cache_hand].referenced) {
+        cache_slots[cache_hand].referenced = false;
+        cache_hand = (cache_hand + 1) % cache_slots.size();
+    }
+    CacheSlot& slot = cache_slots[cache_hand];
+    cache_map.erase(slot.number);
+    cache_evicted++;
+    slot.number = number;
+    slot.data = data;
+    slot.referenced = true;
+    cache_map[number] = cache_hand;
+    cache_hand = (cache_hand + 1) % cache_slots.size();
+}
+
+// ---------------- compressed archives ----------------
+// test.tar may also be a gzip or zstd compressed tar (told apart by the magic bytes). Offsets
+// everywhere else stay tar stream offsets, read_archive() turns them into decompression:
+// a decoder restarts from the nearest checkpoint at or before the offset
+//   gzip: zran style access point, a deflate block boundary plus the 32 KiB window before it,
+//         one every ARCHIVE_SPAN bytes of output (and one per gzip member)
+//   zstd: frame start, so multi-frame (pzstd, seekable) files get random access, a single frame only has its start
+// Checkpoints are recorded by whichever decoder first gets past the last one; the indexer's
+// sequential scan (its own decoder, read_scan) does that from the mount on. Blocks decoded for
+// reads go to the block cache and a decoder that stopped at a block end is parked, so the next
+// sequential miss continues from there instead of from a checkpoint.
+#define ARCHIVE_SPAN (4 << 20) // gzip checkpoint distance, each one keeps a window
+#define ARCHIVE_WINDOW 32768
+#define ARCHIVE_CURSORS 4 // parked decoders
+#define ARCHIVE_INPUT_CHUNK (1u << 30) // z_stream counts input in uInt
+
+enum ArchiveFormat { ARCHIVE_TAR, ARCHIVE_GZIP, ARCHIVE_ZSTD };
+ArchiveFormat archive_format = ARCHIVE_TAR;
+
+struct Checkpoint {
+    uint64_t out; // tar stream offset
+    uint64_t in; // compressed file offset
+    int bits; // gzip: unused bits of the byte at in - 1 that belong to the next deflate block
+    bool member_start; // gzip: a member header starts at in, nothing before it is needed
+    vector<unsigned char> window; // gzip: the ARCHIVE_WINDOW bytes of output before out
+};
+
+// deque: push_back keeps references to the existing checkpoints valid for decoders using them
+pthread_mutex_t archive_mutex = PTHREAD_MUTEX_INITIALIZER;
+deque<Checkpoint> checkpoints; // sorted by out, checkpoints[0] is the start of the file
+
+// keep cp if it lies at least distance past the last checkpoint
+void note_checkpoint(uint64_t out, uint64_t in, int bits, bool member_start, uint64_t distance,
+                     const vector<unsigned char>* history, size_t history_pos) {
+    pthread_mutex_lock(&archive_mutex);
+    if (out >= checkpoints.back().out + distance && out > checkpoints.back().out) {
+        Checkpoint cp;
+        cp.out = out;
+        cp.in = in;
+        cp.bits = bits;
+        cp.member_start = member_start;
+        if (history) { // unroll the ring, oldest byte first
+            cp.window.resize(ARCHIVE_WINDOW);
+            for (size_t i = 0; i < ARCHIVE_WINDOW; i++) {
+                cp.window[i] = (*history)[(history_pos + i) % ARCHIVE_WINDOW];
+            }
+        }
+        checkpoints.push_back(move(cp));
+    }
+    pthread_mutex_unlock(&archive_mutex);
+}
+
+// one decompression position, used by a single thread at a time
+class ArchiveDecoder {
+private:
+    z_stream zs;
+    bool zs_ready;
+    bool raw; // restarted inside a gzip member: raw deflate, the member trailer is skipped by hand
+    vector<unsigned char> history; // gzip: ring of the last ARCHIVE_WINDOW output bytes
+    size_t history_pos;
+#ifdef TARFS_ZSTD
+    ZSTD_DCtx* dctx;
+#endif
+    uint64_t in;
+
+    void remember(const char* data, size_t len) {
+        if (len >= ARCHIVE_WINDOW) {
+            memcpy(history.data(), data + len - ARCHIVE_WINDOW, ARCHIVE_WINDOW);
+            history_pos = 0;
+            return;
+        }
+        size_t first = min(len, ARCHIVE_WINDOW - history_pos);
+        memcpy(history.data() + history_pos, data, first);
+        memcpy(history.data(), data + first, len - first);
+        history_pos = (history_pos + len) % ARCHIVE_WINDOW;
+    }
+
+    size_t produce_gzip(char* buffer, size_t len) {
+        size_t produced = 0;
+        while (produced < len && !end) {
+            if (in >= tar_map_size) { // truncated
+                end = true;
+                break;
+            }
+            uInt avail = min((uint64_t)ARCHIVE_INPUT_CHUNK, tar_map_size - in);
+            zs.next_in = (Bytef*)(tar_map + in);
+            zs.avail_in = avail;
+            zs.next_out = (Bytef*)(buffer + produced);
+            zs.avail_out = len - produced;
+            int ret = inflate(&zs, Z_BLOCK);
+            size_t got = (len - produced) - zs.avail_out;
+            in += avail - zs.avail_in;
+            remember(buffer + produced, got);
+            produced += got;
+            out += got;
+            if (ret == Z_STREAM_END) {
+                if (raw) in += 8; // CRC32 and ISIZE of the member
+                // concatenated members (cat a.gz b.gz) continue the same tar stream
+                if (in + 2 <= tar_map_size && (unsigned char)tar_map[in] == 0x1f && (unsigned char)tar_map[in + 1] == 0x8b) {
+                    inflateReset2(&zs, 15 + 32);
+                    raw = false;
+                    note_checkpoint(out, in, 0, true, 1, NULL, 0);
+                } else {
+                    end = true;
+                }
+                continue;
+            }
+            if (ret != Z_OK) { // corrupt or truncated
+                end = true;
+                break;
+            }
+            // end of a deflate block that is not the last one: a place to restart from
+            if ((zs.data_type & 128) && !(zs.data_type & 64)) {
+                note_checkpoint(out, in, zs.data_type & 7, false, ARCHIVE_SPAN, &history, history_pos);
+            }
+        }
+        return produced;
+    }
+
+#ifdef TARFS_ZSTD
+    size_t produce_zstd(char* buffer, size_t len) {
+        size_t produced = 0;
+        while (produced < len && !end) {
+            ZSTD_inBuffer input = {tar_map + in, tar_map_size - in, 0};
+            ZSTD_outBuffer output = {buffer + produced, len - produced, 0};
+            size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+            in += input.pos;
+            produced += output.pos;
+            out += output.pos;
+            if (ZSTD_isError(ret)) {
+                end = true;
+                break;
+            }
+            if (ret == 0) { // a frame ended, the next one can be decoded on its own
+                if (in >= tar_map_size) end = true;
+                else note_checkpoint(out, in, 0, false, 1, NULL, 0);
+            } else if (input.pos == 0 && output.pos == 0) { // truncated
+                end = true;
+            }
+        }
+        return produced;
+    }
+#endif
+
+public:
+    uint64_t out; // tar stream offset of the next byte produced
+    bool end;
+
+    ArchiveDecoder() : zs_ready(false), raw(false), history_pos(0), in(0), out(0), end(false) {
+        memset(&zs, 0, sizeof(zs));
+#ifdef TARFS_ZSTD
+        dctx = NULL;
+#endif
+    }
+    ~ArchiveDecoder() {
+        if (zs_ready) inflateEnd(&zs);
+#ifdef TARFS_ZSTD
+        if (dctx) ZSTD_freeDCtx(dctx);
+#endif
+    }
+
+    bool start(const Checkpoint& cp) {
+        in = cp.in;
+        out = cp.out;
+        end = false;
+#ifdef TARFS_ZSTD
+        if (archive_format == ARCHIVE_ZSTD) {
+            dctx = ZSTD_createDCtx();
+            return dctx != NULL;
+        }
+#endif
+        raw = !cp.member_start;
+        if (inflateInit2(&zs, raw ? -15 : 15 + 32) != Z_OK) return false;
+        zs_ready = true;
+        history.assign(ARCHIVE_WINDOW, 0);
+        history_pos = 0;
+        if (raw) {
+            if (cp.bits) inflatePrime(&zs, cp.bits, (unsigned char)tar_map[cp.in - 1] >> (8 - cp.bits));
+            inflateSetDictionary(&zs, cp.window.data(), ARCHIVE_WINDOW);
+            history = cp.window;
+        }
+        return true;
+    }
+
+    // next len bytes of the tar stream, fewer only at its end
+    size_t produce(char* buffer, size_t len) {
+#ifdef TARFS_ZSTD
+        if (archive_format == ARCHIVE_ZSTD) return produce_zstd(buffer, len);
+#endif
+        return produce_gzip(buffer, len);
+    }
+};
+
+vector<ArchiveDecoder*> parked_decoders; // each stopped at a block boundary
+
+// the last checkpoint at or before tar stream offset target, the caller holds archive_mutex
+const Checkpoint* checkpoint_before(uint64_t target) {
+    return &*(upper_bound(checkpoints.begin(), checkpoints.end(), target,
+                          [](uint64_t value, const Checkpoint& c) { return value < c.out; }) - 1);
+}
+
+// decode block number of the tar stream, NULL past its end
+ArchiveBlock decode_archive_block(uint64_t number) {
+    uint64_t target = number * CACHE_BLOCK;
+    ArchiveDecoder* decoder = NULL;
+    const Checkpoint* cp = NULL;
+
+    pthread_mutex_lock(&archive_mutex);
+    // start from whatever is closest below the block: a parked decoder or a checkpoint
+    cp = checkpoint_before(target);
+    size_t best = parked_decoders.size();
+    for (size_t i = 0; i < parked_decoders.size(); i++) {
+        uint64_t pos = parked_decoders[i]->out;
+        if (pos <= target && pos >= cp->out && (best == parked_decoders.size() || pos > parked_decoders[best]->out)) best = i;
+    }
+    if (best < parked_decoders.size()) {
+        decoder = parked_decoders[best];
+        parked_decoders.erase(parked_decoders.begin() + best);
+    }
+    pthread_mutex_unlock(&archive_mutex);
+
+    if (!decoder) {
+        decoder = new ArchiveDecoder;
+        if (!decoder->start(*cp)) {
+            delete decoder;
+            return NULL;
+        }
+    }
+
+    // decode up to the block, everything complete on the way is cached too
+    ArchiveBlock result;
+    vector<char> skip_buffer;
+    while (!result && !decoder->end) {
+        uint64_t block_start = (decoder->out + CACHE_BLOCK - 1) / CACHE_BLOCK * CACHE_BLOCK;
+        if (decoder->out != block_start) { // a checkpoint inside a block, only the part up to the boundary
+            skip_buffer.resize(block_start - decoder->out);
+            decoder->produce(skip_buffer.data(), skip_buffer.size());
+            continue;
+        }
+        shared_ptr<BlockBuffer> data = make_shared<BlockBuffer>(CACHE_BLOCK);
+        data->resize(decoder->produce(data->data(), CACHE_BLOCK));
+        if (data->empty()) break;
+        if (block_start == target) {
+            result = data; // the caller caches it
+            break;
+        }
+        pthread_mutex_lock(&cache_mutex);
+        cache_insert(block_start / CACHE_BLOCK, data);
+        pthread_mutex_unlock(&cache_mutex);
+    }
+
+    if (!decoder->end) {
+        pthread_mutex_lock(&archive_mutex);
+        parked_decoders.push_back(decoder);
+        if (parked_decoders.size() > ARCHIVE_CURSORS) { // drop the oldest
+            decoder = parked_decoders.front();
+            parked_decoders.erase(parked_decoders.begin());
+        } else {
+            decoder = NULL;
+        }
+        pthread_mutex_unlock(&archive_mutex);
+    }
+    delete decoder;
+    return result;
+}
+
+void open_tar_archive(){
+    tar_fd = open(tar_filename, O_RDONLY);
+    if (tar_fd < 0) {
         perror("Cannot open test.tar");
         exit(1);
     }
+    if (fstat(tar_fd, &tar_stat) == 0 && tar_stat.st_size > 0) {
+        void* addr = mmap(NULL, tar_stat.st_size, PROT_READ, MAP_SHARED, tar_fd, 0);
+        if (addr != MAP_FAILED) {
+            tar_map = (const char*)addr;
+            tar_map_size = tar_stat.st_size;
+        }
+    }
 
-    struct PosixHeader header;
-    size_t cur = 0; // current byte offset
-
-    strcpy(root->name, "/");
-    root->type = S_IFDIR;
-    root->mode = S_IFDIR | 0755;
+    unsigned char magic[4] = {0};
+    if (pread(tar_fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic)) {
+        if (magic[0] == 0x1f && magic[1] == 0x8b) archive_format = ARCHIVE_GZIP;
+        else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) archive_format = ARCHIVE_ZSTD;
+    }
+    if (archive_format == ARCHIVE_TAR) return;
+#ifndef TARFS_ZSTD
+    if (archive_format == ARCHIVE_ZSTD) {
+        fprintf(stderr, "test.tar is zstd compressed, build with zstd.h and -lzstd to mount it\n");
+        exit(1);
+    }
+#endif
+    if (!tar_map) { // decoders read their input straight from the mapping
+        perror("Cannot map test.tar");
+        exit(1);
+    }
+    Checkpoint start;
+    start.out = start.in = 0;
+    start.bits = 0;
+    start.member_start = true;
+    checkpoints.push_back(start);
+}
 
-    while (fread(&header, 512, 1, fp) > 0) {
-        cur += 512; // read a header size once
-        if (header.name[0] == '\0') break; // tar EOF
+// plain archive bytes, from the mapping or pread; fewer at its end, -errno on a read error
+ssize_t read_plain(uint64_t offset, char* buffer, size_t len) {
+    if (tar_map) { // copy straight from the mapping
+        if (offset >= tar_map_size) return 0; // truncated archive
+        len = min((uint64_t)len, tar_map_size - offset);
+        memcpy(buffer, tar_map + offset, len);
+        return len;
+    }
 
-        FileNode* node = new FileNode();
-        string full_path = header.name;        
-        if (!full_path.empty() && full_path.back() == '/') {
-            full_path.pop_back();
+    // pread has no shared file position, so concurrent reads don't need a lock
+    size_t bytes_read = 0;
+    while (bytes_read < len) {
+        ssize_t n = pread(tar_fd, buffer + bytes_read, len - bytes_read, offset + bytes_read);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno; // 回傳系統錯誤碼
         }
-        vector<string> parts = split_path(full_path.c_str());
-        string filename = parts.back();
-        strcpy(node->name, filename.c_str());
+        if (n == 0) break; // truncated archive
+        bytes_read += n;
+    }
+    return bytes_read;
+}
 
-        int size = octal_to_int(header.size);
-        int mode = octal_to_int(header.mode);
-        node->size = size;
-        node->offset = cur;
-        node->uid = octal_to_int(header.uid);
-        node->gid = octal_to_int(header.gid);
-        node->mtime = octal_to_int(header.mtime);
-        
-        if(header.typeflag == '0'){ // regular file
-            node->type = S_IFREG; // oct 0100000
-            node->mode = S_IFREG | mode;
+ArchiveBlock load_archive_block(uint64_t number) {
+    if (archive_format != ARCHIVE_TAR) return decode_archive_block(number);
+    shared_ptr<BlockBuffer> data = make_shared<BlockBuffer>(CACHE_BLOCK);
+    ssize_t n = read_plain(number * CACHE_BLOCK, data->data(), CACHE_BLOCK);
+    if (n <= 0) return NULL;
+    data->resize(n);
+    return data;
+}
+
+// block number of the tar stream, NULL past its end or on a read error.
+// prefetch: a readahead load, it never waits and does not count as a hit or miss
+ArchiveBlock get_archive_block(uint64_t number, bool prefetch) {
+    pthread_mutex_lock(&cache_mutex);
+    while (true) {
+        auto hit = cache_map.find(number);
+        if (hit != cache_map.end()) {
+            CacheSlot& slot = cache_slots[hit->second];
+            slot.referenced = true;
+            ArchiveBlock data = slot.data;
+            pthread_mutex_unlock(&cache_mutex);
+            if (!prefetch) cache_hits++;
+            return data;
         }
-        else if(header.typeflag == '5'){ // directory
-            node->type = S_IFDIR; // oct 0040000
-            node->mode = S_IFDIR | mode;
-            node->size = 0;
+        if (!cache_loading.count(number)) break;
+        if (prefetch) { // already on its way
+            pthread_mutex_unlock(&cache_mutex);
+            return NULL;
         }
-        else if(header.typeflag == '2'){ // symlink
-            node->type = S_IFLNK; // oct 0120000
-            node->mode = S_IFLNK | mode;
-            node->size = 0;
-            strcpy(node->link_target, header.linkname);
+        pthread_cond_wait(&cache_loaded, &cache_mutex);
+    }
+    cache_loading.insert(number);
+    pthread_mutex_unlock(&cache_mutex);
+
+    ArchiveBlock data = load_archive_block(number);
+    if (prefetch) cache_prefetched++;
+    else cache_misses++;
+
+    pthread_mutex_lock(&cache_mutex);
+    if (data) cache_insert(number, data);
+    cache_loading.erase(number);
+    pthread_cond_broadcast(&cache_loaded);
+    pthread_mutex_unlock(&cache_mutex);
+    return data;
+}
+
+// the archive is served from its mapping, without the block cache
+static inline bool archive_mapped() {
+    return archive_format == ARCHIVE_TAR && tar_map;
+}
+
+// len bytes of the tar stream at offset, fewer at its end, -EIO on a read error
+ssize_t read_archive(uint64_t offset, char* buffer, size_t len) {
+    if (archive_mapped()) return read_plain(offset, buffer, len);
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        ArchiveBlock block = get_archive_block(pos / CACHE_BLOCK, false);
+        size_t in_block = pos % CACHE_BLOCK;
+        if (!block || in_block >= block->size()) { // end of the stream
+            if (!block && done == 0 && archive_format == ARCHIVE_TAR && pos < (uint64_t)tar_stat.st_size) return -EIO;
+            break;
         }
+        size_t n = min(len - done, block->size() - in_block);
+        memcpy(buffer + done, block->data() + in_block, n);
+        done += n;
+    }
+    return done;
+}
 
-        FileNode* parent = get_parent_node(root, header.name);
+// The indexer's headers bypass the block cache, the scan would only push file contents out of
+// it: a plain archive is read directly, a compressed one through the scan's own decoder, which
+// only moves forward (it records the checkpoints on the way) and keeps the last CACHE_BLOCK
+// bytes it produced. Only the indexer thread uses it.
+ArchiveDecoder* scan_decoder = NULL;
+vector<char> scan_window;
+uint64_t scan_window_start = 0; // tar stream offset of scan_window[0]
 
-        FileNode* existing = NULL; // check if we have build a default node
-        for (auto child : parent->childs) {
-            if (strcmp(child->name, node->name) == 0) {
-                existing = child;
+ssize_t read_scan(uint64_t offset, char* buffer, size_t len) {
+    if (archive_format == ARCHIVE_TAR) return read_plain(offset, buffer, len);
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        if (scan_decoder && pos >= scan_window_start && pos < scan_window_start + scan_window.size()) {
+            size_t n = min(len - done, (size_t)(scan_window_start + scan_window.size() - pos));
+            memcpy(buffer + done, scan_window.data() + (pos - scan_window_start), n);
+            done += n;
+            continue;
+        }
+        if (!scan_decoder || pos < scan_window_start) { // behind the decoder, start again from a checkpoint
+            delete scan_decoder;
+            scan_decoder = new ArchiveDecoder;
+            pthread_mutex_lock(&archive_mutex);
+            const Checkpoint* cp = checkpoint_before(pos);
+            pthread_mutex_unlock(&archive_mutex);
+            if (!scan_decoder->start(*cp)) {
+                delete scan_decoder;
+                scan_decoder = NULL;
                 break;
             }
         }
+        // member data in front of pos is decoded into the window and dropped
+        scan_window.resize(CACHE_BLOCK);
+        scan_window_start = scan_decoder->out;
+        scan_window.resize(scan_decoder->produce(scan_window.data(), CACHE_BLOCK));
+        if (scan_window.empty()) break; // end of the stream
+    }
+    return done;
+}
+
+void end_scan() {
+    delete scan_decoder;
+    scan_decoder = NULL;
+    vector<char>().swap(scan_window);
+}
+
+bool read_tar_block(uint64_t offset, void* block) {
+    return read_scan(offset, (char*)block, 512) == 512;
+}
+
+// ---------------- readahead ----------------
+// Every open file remembers where its last read ended. A read that continues there is
+// sequential: the window ahead of it doubles from READAHEAD_MIN up to READAHEAD_MAX and the
+// blocks in it are queued for the prefetch threads, which load them into the cache while the
+// reader is still copying the previous ones (a mapped archive: madvise(MADV_WILLNEED) on the
+// window, the kernel reads it in). A read anywhere else closes the window again.
+#define READAHEAD_MIN (2 * CACHE_BLOCK)
+#define READAHEAD_MAX (32 * CACHE_BLOCK) // 4 MiB
+#define PREFETCH_THREADS 2
+#define PREFETCH_QUEUE 256 // queued blocks, the oldest requests are dropped beyond it
+
+struct OpenFile {
+    uint32_t index;
+    FileNode node; // copied at open, reads need no index access
+    pthread_mutex_t lock; // the kernel may send reads of one handle in parallel
+    uint64_t next_offset; // where a sequential read continues
+    uint64_t window;
+    uint64_t prefetched_until;
+    string text; // the stats file (index NIL_NODE): its report, taken at open
+};
+
+pthread_mutex_t prefetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t prefetch_wakeup = PTHREAD_COND_INITIALIZER;
+deque<uint64_t> prefetch_queue;
+bool prefetch_stop = false;
+pthread_t prefetch_threads[PREFETCH_THREADS];
+int prefetch_thread_count = 0;
+
+void* prefetch_thread_function(void* arg){
+    pthread_mutex_lock(&prefetch_mutex);
+    while (true) {
+        while (prefetch_queue.empty() && !prefetch_stop) pthread_cond_wait(&prefetch_wakeup, &prefetch_mutex);
+        if (prefetch_stop) break;
+        uint64_t number = prefetch_queue.front();
+        prefetch_queue.pop_front();
+        pthread_mutex_unlock(&prefetch_mutex);
+        get_archive_block(number, true);
+        pthread_mutex_lock(&prefetch_mutex);
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+    return NULL;
+}
+
+// a read of [pos, pos + size) in the tar stream just finished on file
+void readahead(OpenFile* file, uint64_t pos, size_t size) {
+    if (!archive_mapped() && prefetch_thread_count == 0) return;
+    uint64_t max_window = archive_mapped() ? READAHEAD_MAX : min((uint64_t)READAHEAD_MAX, (uint64_t)cache_blocks * CACHE_BLOCK / 4);
+    uint64_t first, last;
+    pthread_mutex_lock(&file->lock);
+    if (pos == file->next_offset) {
+        file->window = file->window ? min(file->window * 2, max_window) : min((uint64_t)READAHEAD_MIN, max_window);
+    } else {
+        file->window = 0;
+        file->prefetched_until = 0;
+    }
+    file->next_offset = pos + size;
+    first = max(pos + size, file->prefetched_until);
+    last = min(pos + size + file->window, file->node.offset + file->node.size);
+    if (first < last) file->prefetched_until = last;
+    pthread_mutex_unlock(&file->lock);
+    if (first >= last) return;
+
+    if (archive_mapped()) {
+        last = min(last, (uint64_t)tar_map_size);
+        if (first >= last) return;
+        uint64_t page = first / getpagesize() * getpagesize();
+        madvise((void*)(tar_map + page), last - page, MADV_WILLNEED);
+        return;
+    }
+
+    pthread_mutex_lock(&prefetch_mutex);
+    for (uint64_t number = first / CACHE_BLOCK; number <= (last - 1) / CACHE_BLOCK; number++) {
+        prefetch_queue.push_back(number);
+    }
+    while (prefetch_queue.size() > PREFETCH_QUEUE) prefetch_queue.pop_front();
+    pthread_cond_broadcast(&prefetch_wakeup);
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+void start_prefetch_threads(){
+    for (int i = 0; i < PREFETCH_THREADS; i++) {
+        if (pthread_create(&prefetch_threads[prefetch_thread_count], NULL, prefetch_thread_function, NULL) == 0) {
+            prefetch_thread_count++;
+        }
+    }
+}
+
+void stop_prefetch_threads(){
+    pthread_mutex_lock(&prefetch_mutex);
+    prefetch_stop = true;
+    pthread_cond_broadcast(&prefetch_wakeup);
+    pthread_mutex_unlock(&prefetch_mutex);
+    for (int i = 0; i < prefetch_thread_count; i++) pthread_join(prefetch_threads[i], NULL);
+    prefetch_thread_count = 0;
+}
+
+void init_tar_index(){
+    append_string("", 0); // offset 0: empty name / no link target
+    string_slots.assign(1024, 0);
+    add_node(NIL_NODE, "/", 1);
+    nodes[ROOT_NODE].mode = S_IFDIR | 0755;
+    nodes[ROOT_NODE].owner = add_owner(0, 0);
+}
+
+// the tree is complete: lay every directory's children out next to each other (a counting
+// sort by parent keeps archive order) and drop what only the scan needed. Members below a
+// path that turned out to be a file ("a" then "a/b") cannot be listed and are left out.
+void finish_tar_index(){
+    for (uint32_t i = 0; i < node_count; ++i) {
+        if (node_type(i) == S_IFDIR) nodes[i].count = 0;
+    }
+    for (uint32_t i = 1; i < node_count; ++i) {
+        if (node_type(nodes[i].parent) == S_IFDIR) nodes[nodes[i].parent].count++;
+    }
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < node_count; ++i) {
+        if (node_type(i) != S_IFDIR) continue;
+        nodes[i].first = next;
+        next += nodes[i].count;
+        nodes[i].count = 0;
+    }
+    child_store.assign(next, NIL_NODE);
+    for (uint32_t i = 1; i < node_count; ++i) {
+        FileNode& parent = nodes[nodes[i].parent];
+        if (node_type(nodes[i].parent) == S_IFDIR) child_store[parent.first + parent.count++] = i;
+    }
+    child_index = child_store.data();
+
+    // link counts: a directory has 2 + one per subdirectory ("." and their ".."), a file one
+    // per name sharing its data (hard links)
+    for (uint32_t i = 0; i < node_count; ++i) {
+        if (node_type(i) != S_IFDIR) continue;
+        uint32_t links = 2;
+        for (uint32_t c = 0; c < nodes[i].count; ++c) {
+            if (node_type(child_index[nodes[i].first + c]) == S_IFDIR) links++;
+        }
+        nodes[i].nlink = links > 0xffff ? 1 : links;
+    }
+    if (!hardlink_offsets.empty()) {
+        unordered_map<uint64_t, uint32_t> names;
+        for (uint64_t offset : hardlink_offsets) names[offset] = 0;
+        for (uint32_t i = 0; i < node_count; ++i) {
+            if (node_type(i) == S_IFREG && names.count(nodes[i].offset)) names[nodes[i].offset]++;
+        }
+        for (uint32_t i = 0; i < node_count; ++i) {
+            if (node_type(i) == S_IFREG && names.count(nodes[i].offset)) nodes[i].nlink = min(names[nodes[i].offset], 0xffffu);
+        }
+    }
+
+    vector<uint32_t>().swap(string_slots);
+    vector<uint64_t>().swap(hardlink_offsets);
+    unordered_map<uint64_t, uint32_t>().swap(owner_map);
+    node_store.shrink_to_fit();
+    string_store.shrink_to_fit();
+    nodes = node_store.data();
+    string_pool = string_store.data();
+}
+
+// Pending metadata of the next member. GNU 'L' / 'K' records (long name / long link target)
+// and PAX 'x' headers only apply to the member right after them, PAX 'g' headers to every
+// member after them.
+#define TAR_META_MAX (16 << 20) // larger L/K/x/g records are skipped
+
+struct TarMeta {
+    string path, linkpath;
+    bool has_path = false, has_linkpath = false, has_size = false, has_mtime = false, has_uid = false, has_gid = false;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint32_t uid = 0, gid = 0;
+    // GNU sparse in PAX: 0.0 lists GNU.sparse.offset / numbytes pairs, 0.1 has them in
+    // GNU.sparse.map, 1.0 stores the map in front of the data
+    bool sparse = false, has_sparse_name = false;
+    int sparse_major = 0;
+    uint64_t sparse_realsize = 0;
+    string sparse_name;
+    vector<pair<uint64_t, uint64_t>> sparse_map; // (offset, numbytes)
+};
+
+TarMeta pax_global;
+
+// "<length> <key>=<value>\n" records, length counts the whole record
+void parse_pax_records(const string& data, TarMeta& meta) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        const char* record = data.c_str() + pos;
+        char* space;
+        unsigned long long len = strtoull(record, &space, 10);
+        if (*space != ' ' || len == 0 || pos + len > data.size()) break; // malformed, ignore the rest
+        const char* key = space + 1;
+        const char* end = record + len - 1; // the '\n'
+        const char* eq = (const char*)memchr(key, '=', end > key ? end - key : 0);
+        pos += len;
+        if (!eq) continue;
+        string name(key, eq - key), value(eq + 1, end - eq - 1);
+        if (name == "path") {
+            meta.path = value;
+            meta.has_path = true;
+        } else if (name == "linkpath") {
+            meta.linkpath = value;
+            meta.has_linkpath = true;
+        } else if (name == "size") {
+            meta.size = strtoull(value.c_str(), NULL, 10);
+            meta.has_size = true;
+        } else if (name == "mtime") { // may have a fraction, seconds are enough
+            meta.mtime = strtoll(value.c_str(), NULL, 10);
+            meta.has_mtime = true;
+        } else if (name == "uid") {
+            meta.uid = strtoul(value.c_str(), NULL, 10);
+            meta.has_uid = true;
+        } else if (name == "gid") {
+            meta.gid = strtoul(value.c_str(), NULL, 10);
+            meta.has_gid = true;
+        } else if (name == "GNU.sparse.major") {
+            meta.sparse_major = atoi(value.c_str());
+            meta.sparse = true;
+        } else if (name == "GNU.sparse.name") {
+            meta.sparse_name = value;
+            meta.has_sparse_name = true;
+        } else if (name == "GNU.sparse.realsize" || name == "GNU.sparse.size") {
+            meta.sparse_realsize = strtoull(value.c_str(), NULL, 10);
+            meta.sparse = true;
+        } else if (name == "GNU.sparse.offset") {
+            meta.sparse_map.push_back(make_pair(strtoull(value.c_str(), NULL, 10), 0));
+        } else if (name == "GNU.sparse.numbytes") {
+            if (!meta.sparse_map.empty()) meta.sparse_map.back().second = strtoull(value.c_str(), NULL, 10);
+        } else if (name == "GNU.sparse.map") {
+            const char* p = value.c_str();
+            while (*p) {
+                char* next;
+                uint64_t start = strtoull(p, &next, 10);
+                if (*next != ',') break;
+                uint64_t len = strtoull(next + 1, &next, 10);
+                meta.sparse_map.push_back(make_pair(start, len));
+                if (*next != ',') break;
+                p = next + 1;
+            }
+        }
+    }
+}
+
+bool read_tar_content(uint64_t offset, uint64_t size, string& content) {
+    if (size > TAR_META_MAX) return false;
+    content.resize(size);
+    return read_scan(offset, &content[0], size) == (ssize_t)size;
+}
+
+// GNU sparse 1.0 map in front of the data at offset: decimal lines, the extent count and then
+// offset and numbytes of every extent, padded to whole blocks. Returns its size, 0 if broken
+uint64_t read_sparse_map(uint64_t offset, vector<pair<uint64_t, uint64_t>>& map) {
+    string text;
+    vector<uint64_t> numbers;
+    size_t parsed = 0;
+    while (text.size() < TAR_META_MAX) {
+        char block[512];
+        if (!read_tar_block(offset + text.size(), block)) return 0;
+        text.append(block, sizeof(block));
+        size_t newline;
+        while ((newline = text.find('\n', parsed)) != string::npos) {
+            numbers.push_back(strtoull(text.c_str() + parsed, NULL, 10));
+            parsed = newline + 1;
+            if (numbers.size() == 1 + 2 * numbers[0]) {
+                for (uint64_t i = 0; i < numbers[0]; ++i) map.push_back(make_pair(numbers[1 + 2 * i], numbers[2 + 2 * i]));
+                return text.size();
+            }
+        }
+    }
+    return 0;
+}
+
+// old GNU 'S' header: 4 (offset, numbytes) pairs in the header, more in extension blocks
+void add_gnu_sparse_entries(const char* entries, int count, vector<pair<uint64_t, uint64_t>>& map) {
+    for (int i = 0; i < count; ++i) {
+        const char* entry = entries + i * 24;
+        if (entry[0] == '\0') break; // unused slots are empty
+        map.push_back(make_pair(parse_tar_number(entry, 12), parse_tar_number(entry + 12, 12)));
+    }
+}
 
-        if (existing) { // default node exists, update its info
-            existing->size = node->size;
-            existing->mode = node->mode;
-            existing->type = node->type;
-            existing->offset = node->offset;
-            existing->uid = node->uid;
-            existing->gid = node->gid;
-            existing->mtime = node->mtime;
-            strcpy(existing->link_target, node->link_target);
-            delete node;
+// "./a//b/" -> "/a/b", the form lookup_path expects
+string join_path(const vector<string>& parts) {
+    string path;
+    for (const string& part : parts) path += "/" + part;
+    return path.empty() ? "/" : path;
+}
+
+// one member as read from the archive: everything add_tar_entry needs to put it in the tree
+struct TarEntry {
+    PosixHeader header;
+    TarMeta meta;
+    uint64_t size;
+    uint64_t content_offset;
+    bool sparse;
+    uint64_t realsize;
+    vector<pair<uint64_t, uint64_t>> sparse_map;
+    vector<string> parts; // path components, empty: nothing to add (the root, GNU volume records)
+    string link;
+};
+
+// read the member whose header is at cur (after the L / K / x / g records in front of it) and
+// move cur to the next header, false at the end of the archive. Only reads the archive, so the
+// indexer runs it without index_mutex (a compressed archive decodes all the data in between)
+bool read_tar_entry(uint64_t& cur, TarEntry& entry){
+    PosixHeader& header = entry.header;
+    TarMeta& meta = entry.meta;
+    meta = pax_global;
+    while (true) {
+        if (!read_tar_block(cur, &header)) return false;
+        if (header.name[0] == '\0') return false; // tar EOF
+        char type = header.typeflag;
+        if (type != 'L' && type != 'K' && type != 'x' && type != 'g') break;
+
+        uint64_t size = parse_tar_number(header.size, sizeof(header.size));
+        string content;
+        if (read_tar_content(cur + 512, size, content)) {
+            if (type == 'L') {
+                meta.path = content.c_str(); // NUL terminated inside the record
+                meta.has_path = true;
+            } else if (type == 'K') {
+                meta.linkpath = content.c_str();
+                meta.has_linkpath = true;
+            } else if (type == 'g') {
+                parse_pax_records(content, pax_global);
+                parse_pax_records(content, meta);
+            } else {
+                parse_pax_records(content, meta);
+            }
+        }
+        cur += 512 + (size + 511) / 512 * 512;
+    }
+
+    uint64_t size = meta.has_size ? meta.size : (uint64_t)parse_tar_number(header.size, sizeof(header.size));
+    uint64_t content_offset = cur + 512;
+
+    // sparse members: size counts the stored data only, the file is realsize long
+    bool sparse = header.typeflag == 'S' || meta.sparse;
+    vector<pair<uint64_t, uint64_t>> sparse_map;
+    uint64_t realsize = 0;
+    if (header.typeflag == 'S') {
+        const char* raw = (const char*)&header; // oldgnu layout: sparse[4] at 386, isextended at 482, realsize at 483
+        add_gnu_sparse_entries(raw + 386, 4, sparse_map);
+        realsize = parse_tar_number(raw + 483, 12);
+        bool extended = raw[482] != 0;
+        while (extended) { // extension blocks sit between the header and the data, outside of size
+            char block[512];
+            if (!read_tar_block(content_offset, block)) return false;
+            content_offset += 512;
+            add_gnu_sparse_entries(block, 21, sparse_map);
+            extended = block[504] != 0;
+        }
+    }
+    cur = content_offset + (size + 511) / 512 * 512; // move by at least 512 bytes (1 block)
+    entry.parts.clear();
+    if (header.typeflag == 'V' || header.typeflag == 'M' || header.typeflag == 'N') return true; // GNU volume records, no member
+    if (meta.sparse) {
+        realsize = meta.sparse_realsize;
+        if (meta.sparse_major == 1) {
+            uint64_t map_size = read_sparse_map(content_offset, sparse_map);
+            if (map_size == 0) sparse = false; // unreadable map, the stored bytes as they are
+            content_offset += map_size;
         } else {
-            parent->childs.push_back(node);
+            sparse_map = meta.sparse_map;
+        }
+    }
+
+    // POSIX ustar splits long paths into prefix "/" name, GNU tar uses the prefix field for other things
+    string full_path;
+    if (meta.has_sparse_name) { // the PAX path is a made up GNUSparseFile.N/name
+        full_path = meta.sparse_name;
+    } else if (meta.has_path) {
+        full_path = meta.path;
+    } else {
+        full_path.assign(header.name, strnlen(header.name, sizeof(header.name)));
+        if (memcmp(header.magic, "ustar", 6) == 0 && header.prefix[0] != '\0') {
+            full_path = string(header.prefix, strnlen(header.prefix, sizeof(header.prefix))) + "/" + full_path;
+        }
+    }
+    entry.link = meta.has_linkpath ? meta.linkpath : string(header.linkname, strnlen(header.linkname, sizeof(header.linkname)));
+    entry.parts = split_path(full_path.c_str()); // "./" itself: empty, the root is already there
+    entry.size = size;
+    entry.content_offset = content_offset;
+    entry.sparse = sparse;
+    entry.realsize = realsize;
+    entry.sparse_map.swap(sparse_map);
+    return true;
+}
+
+// put a member read by read_tar_entry into the tree, the caller holds index_mutex
+void add_tar_entry(const TarEntry& entry){
+    const vector<string>& parts = entry.parts;
+    if (parts.empty()) return;
+    const PosixHeader& header = entry.header;
+    const TarMeta& meta = entry.meta;
+    const string& link = entry.link;
+    const vector<pair<uint64_t, uint64_t>>& sparse_map = entry.sparse_map;
+    uint64_t size = entry.size, content_offset = entry.content_offset, realsize = entry.realsize;
+    bool sparse = entry.sparse;
+    const string& filename = parts.back();
+
+    uint32_t parent = get_parent_node(parts);
+
+    uint32_t index = find_child(parent, filename.c_str(), filename.size()); // check if we have build a default node
+    if (index == NIL_NODE) {
+        index = add_node(parent, filename.c_str(), filename.size());
+    }
+    // a default node already there just gets its info updated
+    char type = header.typeflag;
+    uint32_t link_target = 0;
+    if (type == '2') {
+        link_target = add_string(link.c_str(), link.size());
+    }
+    uint32_t owner = add_owner(meta.has_uid ? meta.uid : parse_tar_number(header.uid, sizeof(header.uid)),
+                               meta.has_gid ? meta.gid : parse_tar_number(header.gid, sizeof(header.gid)));
+    FileNode& node = nodes[index];
+
+    uint32_t mode = parse_tar_number(header.mode, sizeof(header.mode)) & 07777;
+    node.size = size;
+    node.offset = content_offset;
+    node.owner = owner;
+    node.mtime = meta.has_mtime ? meta.mtime : parse_tar_number(header.mtime, sizeof(header.mtime));
+    node.mode = 0;
+    node.flags &= ~(NODE_IMPLICIT | NODE_SPARSE);
+    node.first = node.count = 0;
+
+    if (type == '1') { // hard link: an alias of an earlier member, same data extent and attributes
+        uint32_t target = lookup_path(join_path(split_path(link.c_str())).c_str());
+        if (target != NIL_NODE && target != index && node_type(target) != S_IFDIR) {
+            node.size = nodes[target].size;
+            node.offset = nodes[target].offset;
+            node.owner = nodes[target].owner;
+            node.mtime = nodes[target].mtime;
+            node.mode = nodes[target].mode;
+            node.flags |= nodes[target].flags & NODE_SPARSE;
+            node.first = nodes[target].first;
+            node.count = nodes[target].count;
+            hardlink_offsets.push_back(node.offset);
+            return;
+        }
+        node.mode = S_IFREG | mode; // target missing from the archive: an empty file
+        node.size = 0;
+    }
+    else if (type == '5' || type == 'D') { // directory (GNU 'D': with a dump of its entries as content)
+        node.mode = S_IFDIR | mode; // oct 0040000
+        node.size = 0;
+    }
+    else if (type == '2') { // symlink
+        node.mode = S_IFLNK | mode; // oct 0120000
+        node.size = 0;
+        node.offset = link_target; // no content, the field holds the target
+    }
+    else if (type == '3' || type == '4') { // character / block device, the field holds the device number
+        node.mode = (type == '3' ? S_IFCHR : S_IFBLK) | mode;
+        node.size = 0;
+        node.offset = makedev(parse_tar_number(header.devmajor, sizeof(header.devmajor)),
+                              parse_tar_number(header.devminor, sizeof(header.devminor)));
+    }
+    else if (type == '6') { // FIFO
+        node.mode = S_IFIFO | mode;
+        node.size = 0;
+    }
+    else { // '0', '\0' (pre-POSIX), '7' (contiguous) and unknown types are regular files, like tar does
+        node.mode = S_IFREG | mode; // oct 0100000
+        if (sparse) {
+            // stored runs follow each other in the archive, the map is sorted by offset
+            node.flags |= NODE_SPARSE;
+            node.size = realsize;
+            node.first = extent_store.size();
+            uint64_t physical = content_offset;
+            for (const auto& run : sparse_map) {
+                if (run.second == 0) continue; // the map may end with an empty run at realsize
+                extent_store.push_back({run.first, run.second, physical});
+                physical += run.second;
+            }
+            node.count = extent_store.size() - node.first;
+            sparse_extents = extent_store.data();
         }
+    }
+}
+
+// ---------------- sidecar index ----------------
+// <archive>.idx next to the archive holds the index arrays exactly as they are in memory:
+// SidecarHeader | nodes | sparse extents | path slots | child index | owners | string pool. A remount maps it and uses it in place,
+// no tar header is read again. It is trusted only while the archive's size, mtime and a
+// hash of its first and last 64 KiB are unchanged and every link, string and data range in it
+// checks out (check_sidecar), otherwise the archive is indexed again and the file rewritten.
+#define SIDECAR_MAGIC "TARFSIX5"
+#define SIDECAR_HASH_BYTES (64 * 1024)
+
+struct SidecarHeader {
+    char magic[8];
+    uint64_t archive_size;
+    int64_t archive_mtime;
+    uint64_t archive_hash;
+    uint64_t node_count;
+    uint64_t extent_count;
+    uint64_t slot_count;
+    uint64_t child_count;
+    uint64_t owner_count;
+    uint64_t string_bytes;
+};
 
-        size_t content_blocks = (size + 511) / 512;
-        fseek(fp, content_blocks * 512, SEEK_CUR);
-        cur += content_blocks * 512; // move by at least 512 bytes (1 block)
+bool use_sidecar = true; // --no-index-file: always scan the archive, write nothing
+string sidecar_filename;
 
+uint64_t archive_fingerprint(){
+    uint64_t hash = FNV_OFFSET_BASIS;
+    vector<char> buffer(SIDECAR_HASH_BYTES);
+    off_t size = tar_stat.st_size;
+    off_t starts[2] = {0, max((off_t)0, size - SIDECAR_HASH_BYTES)};
+    for (off_t start : starts) {
+        ssize_t n = pread(tar_fd, buffer.data(), buffer.size(), start);
+        if (n > 0) hash = fnv_update(hash, buffer.data(), n);
     }
-    fclose(fp);
+    return hash;
 }
 
-int my_readdir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi) {
+// a stale or corrupt index must not crash the mount or serve bytes from outside the archive:
+// every node index points at an earlier node (so parent chains end at the root), strings start
+// inside the NUL terminated pool, child and extent ranges lie in their arrays and data ranges of
+// a plain archive lie in the file (a compressed stream just ends early)
+bool check_sidecar(const SidecarHeader& header, const FileNode* index_nodes, const SparseExtent* extents,
+                   const uint32_t* slots, const uint32_t* children, const char* pool){
+    uint64_t limit = (archive_format == ARCHIVE_TAR) ? header.archive_size : UINT64_MAX;
+    auto in_archive = [&](uint64_t offset, uint64_t size) { return offset <= limit && size <= limit - offset; };
+    if (header.string_bytes == 0 || pool[header.string_bytes - 1] != '\0') return false;
+    if ((index_nodes[ROOT_NODE].mode & S_IFMT) != S_IFDIR || index_nodes[ROOT_NODE].parent != NIL_NODE) return false;
+    for (uint64_t i = 0; i < header.node_count; ++i) {
+        const FileNode& node = index_nodes[i];
+        if ((i != ROOT_NODE && node.parent >= i) || node.name >= header.string_bytes || node.owner >= header.owner_count) {
+            return false;
+        }
+        uint32_t type = node.mode & S_IFMT;
+        bool valid = true;
+        if (type == S_IFDIR) valid = (uint64_t)node.first + node.count <= header.child_count;
+        else if (type == S_IFLNK) valid = node.offset < header.string_bytes;
+        else if (type == S_IFREG && (node.flags & NODE_SPARSE)) valid = (uint64_t)node.first + node.count <= header.extent_count;
+        else if (type == S_IFREG) valid = in_archive(node.offset, node.size);
+        if (!valid) return false;
+    }
+    for (uint64_t i = 0; i < header.extent_count; ++i) {
+        if (!in_archive(extents[i].physical, extents[i].length)) return false;
+    }
+    for (uint64_t i = 0; i < header.child_count; ++i) {
+        if (children[i] == ROOT_NODE || children[i] >= header.node_count) return false;
+    }
+    bool has_empty_slot = false; // a probe must always end
+    for (uint64_t i = 0; i < header.slot_count; ++i) {
+        if (slots[i] == NIL_NODE) has_empty_slot = true;
+        else if (slots[i] >= header.node_count) return false;
+    }
+    return has_empty_slot;
+}
 
-    FileNode* node = root->find_node(path);
-    if (node == NULL) {
-        return -ENOENT;
+bool load_sidecar(){
+    int fd = open(sidecar_filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    SidecarHeader header;
+    bool valid = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header) &&
+                 pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, SIDECAR_MAGIC, 8) == 0 &&
+                 header.archive_size == (uint64_t)tar_stat.st_size &&
+                 header.archive_mtime == (int64_t)tar_stat.st_mtime &&
+                 header.node_count > 0 && header.node_count < NIL_NODE &&
+                 header.slot_count > header.node_count && (header.slot_count & (header.slot_count - 1)) == 0 &&
+                 header.child_count < header.node_count && header.owner_count > 0 &&
+                 header.slot_count <= (uint64_t)st.st_size && header.extent_count <= (uint64_t)st.st_size &&
+                 header.owner_count <= (uint64_t)st.st_size && header.string_bytes <= (uint64_t)st.st_size && // no overflow below
+                 (uint64_t)st.st_size == sizeof(header) + header.node_count * sizeof(FileNode) +
+                                         header.extent_count * sizeof(SparseExtent) +
+                                         (header.slot_count + header.child_count) * sizeof(uint32_t) +
+                                         header.owner_count * sizeof(Owner) + header.string_bytes &&
+                 header.archive_hash == archive_fingerprint();
+    if (!valid) {
+        close(fd);
+        return false;
     }
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
 
-    if (node->type != S_IFDIR) {
-        return -ENOTDIR;
+    // read only mapping: nothing writes the index once it is complete
+    char* base = (char*)addr + sizeof(header);
+    FileNode* index_nodes = (FileNode*)base;
+    base += header.node_count * sizeof(FileNode);
+    const SparseExtent* extents = (const SparseExtent*)base;
+    base += header.extent_count * sizeof(SparseExtent);
+    uint32_t* slots = (uint32_t*)base;
+    base += header.slot_count * sizeof(uint32_t);
+    const uint32_t* children = (const uint32_t*)base;
+    base += header.child_count * sizeof(uint32_t);
+    const Owner* index_owners = (const Owner*)base;
+    const char* pool = base + header.owner_count * sizeof(Owner);
+    if (!check_sidecar(header, index_nodes, extents, slots, children, pool)) {
+        munmap(addr, st.st_size);
+        return false;
     }
+    nodes = index_nodes;
+    node_count = header.node_count;
+    sparse_extents = extents;
+    path_slots = slots;
+    path_mask = header.slot_count - 1;
+    child_index = children;
+    owners = index_owners;
+    string_pool = pool;
+    return true;
+}
 
-    filler(buffer, ".", NULL, 0);
-    filler(buffer, "..", NULL, 0);
+// written to a temporary file and renamed, so a crash never leaves half an index behind
+void save_sidecar(){
+    SidecarHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SIDECAR_MAGIC, 8);
+    header.archive_size = tar_stat.st_size;
+    header.archive_mtime = tar_stat.st_mtime;
+    header.archive_hash = archive_fingerprint();
+    header.node_count = node_count;
+    header.extent_count = extent_store.size();
+    header.slot_count = slot_store.size();
+    header.child_count = child_store.size();
+    header.owner_count = owner_store.size();
+    header.string_bytes = string_store.size();
 
-    for (auto child : node->childs) {
-        filler(buffer, child->name, NULL, 0);
+    string tmp_filename = sidecar_filename + ".tmp";
+    FILE* fp = fopen(tmp_filename.c_str(), "wb");
+    if (!fp) {
+        perror("Cannot write the index file");
+        return;
     }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(node_store.data(), sizeof(FileNode), node_store.size(), fp) == node_store.size() &&
+              fwrite(extent_store.data(), sizeof(SparseExtent), extent_store.size(), fp) == extent_store.size() &&
+              fwrite(slot_store.data(), sizeof(uint32_t), slot_store.size(), fp) == slot_store.size() &&
+              fwrite(child_store.data(), sizeof(uint32_t), child_store.size(), fp) == child_store.size() &&
+              fwrite(owner_store.data(), sizeof(Owner), owner_store.size(), fp) == owner_store.size() &&
+              fwrite(string_store.data(), 1, string_store.size(), fp) == string_store.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp_filename.c_str(), sidecar_filename.c_str()) != 0) {
+        perror("Cannot write the index file");
+        unlink(tmp_filename.c_str());
+    }
+}
 
-    return 0;
+// ---------------- background indexing ----------------
+// The mount does not wait for the archive to be parsed: my_init starts an indexer
+// thread (fuse_daemonize forks before init when not run with -f, so not earlier). Until it
+// reaches the end of the archive the tree grows under index_mutex; callbacks hold the
+// lock through IndexGuard and wait on index_progress until the entry they need shows up.
+// The indexer reads each member without the lock and takes it only to add that one member,
+// so a callback never waits for archive reads (or decompression) of entries it does not need.
+// After index_done the tree never changes and callbacks take no lock at all.
+
+pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t index_progress = PTHREAD_COND_INITIALIZER;
+atomic<bool> index_done(false);
+atomic<bool> index_stop(false);
+pthread_t index_thread;
+bool index_thread_started = false;
+bool dump_tree = false; // --dump-tree: print the tree once it is indexed
+bool kernel_cache = true; // --no-kernel-cache: no timeouts, no keep_cache
+
+class IndexGuard {
+private:
+    bool locked;
+public:
+    IndexGuard() : locked(!index_done.load(memory_order_acquire)) {
+        if (locked) pthread_mutex_lock(&index_mutex);
+    }
+    ~IndexGuard() {
+        if (locked) pthread_mutex_unlock(&index_mutex);
+    }
+    // a name that is never found waits for the end, then it is really missing
+    uint32_t wait_for_child(uint32_t parent, const char* name) {
+        while (true) {
+            uint32_t index = find_child(parent, name, strlen(name));
+            if (!locked || index_done.load(memory_order_relaxed)) return index;
+            if (index != NIL_NODE && !(nodes[index].flags & NODE_IMPLICIT)) return index;
+            pthread_cond_wait(&index_progress, &index_mutex);
+        }
+    }
+    // complete: the caller needs everything below the node (readdir), which is only known at the end.
+    // an implicit directory waits for its own header, it may still change mode and owner
+    void wait_for_node(uint32_t index, bool complete) {
+        while (locked && !index_done.load(memory_order_relaxed) && (complete || (nodes[index].flags & NODE_IMPLICIT))) {
+            pthread_cond_wait(&index_progress, &index_mutex);
+        }
+    }
+};
+
+void* index_thread_function(void* arg){
+    uint64_t cur = 0; // current byte offset
+    bool end = false;
+    TarEntry entry;
+    while (!end && !index_stop.load(memory_order_relaxed)) {
+        end = !read_tar_entry(cur, entry);
+        if (end || entry.parts.empty()) continue;
+        pthread_mutex_lock(&index_mutex);
+        add_tar_entry(entry);
+        pthread_cond_broadcast(&index_progress);
+        pthread_mutex_unlock(&index_mutex);
+    }
+    end_scan();
+    pthread_mutex_lock(&index_mutex);
+    finish_tar_index();
+    index_done.store(true, memory_order_release);
+    pthread_cond_broadcast(&index_progress);
+    pthread_mutex_unlock(&index_mutex);
+
+    if (end && use_sidecar) save_sidecar(); // only a complete index, not one cut short by unmount
+    if (dump_tree) print_tree(ROOT_NODE);
+    return NULL;
 }
-int my_getattr(const char *path, struct stat *st) {
+
+// ---------------- statistics ----------------
+// Every callback is timed into a log-linear (HDR style) latency histogram: 16 linear buckets
+// per power of two nanoseconds, so a percentile is off by at most 1/16 of its value and
+// recording is a few relaxed atomic adds. `cat tarfs/.tarfs-stats` (a virtual file, not listed
+// by readdir, it hides an archive member of that name) or `kill -USR1 <pid>` (printed on
+// stderr, so run with -f) shows them together with the bytes served and the cache counters.
+#define STATS_NAME ".tarfs-stats"
+#define STATS_INO ((fuse_ino_t)NIL_NODE + FUSE_ROOT_ID) // after every node inode
+#define HIST_SUB_BITS 4 // 16 buckets per power of two
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40 // ~18 minutes, slower calls land in the last bucket
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 2) * HIST_SUB)
+
+enum StatOp { STAT_LOOKUP, STAT_GETATTR, STAT_READDIR, STAT_OPEN, STAT_READ, STAT_READLINK, STAT_OPS };
+const char* stat_op_names[STAT_OPS] = {"lookup", "getattr", "readdir", "open", "read", "readlink"};
+
+struct OpStats {
+    atomic<uint64_t> calls;
+    atomic<uint64_t> errors; // replied with an errno
+    atomic<uint64_t> total_ns;
+    atomic<uint64_t> max_ns;
+    atomic<uint64_t> buckets[HIST_BUCKETS];
+};
+
+OpStats op_stats[STAT_OPS];
+atomic<uint64_t> bytes_served(0);
+uint64_t mount_ns = 0;
+pthread_t stats_thread;
+bool stats_thread_started = false;
+atomic<bool> stats_stop(false);
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint32_t hist_bucket(uint64_t ns) {
+    if (ns < HIST_SUB) return ns;
+    int bits = 63 - __builtin_clzll(ns); // >= HIST_SUB_BITS
+    if (bits > HIST_MAX_BITS) return HIST_BUCKETS - 1;
+    return (bits - HIST_SUB_BITS + 1) * HIST_SUB + ((ns >> (bits - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// largest value that falls into bucket
+static inline uint64_t hist_value(uint32_t bucket) {
+    if (bucket < HIST_SUB) return bucket;
+    int bits = bucket / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t sub = bucket % HIST_SUB;
+    return ((HIST_SUB + sub + 1) << (bits - HIST_SUB_BITS)) - 1;
+}
+
+// times one callback from construction to the end of its scope (the reply included)
+class OpTimer {
+private:
+    StatOp op;
+    uint64_t start;
+    bool failed;
+public:
+    OpTimer(StatOp op) : op(op), start(now_ns()), failed(false) {}
+    void fail() { failed = true; }
+    ~OpTimer() {
+        uint64_t ns = now_ns() - start;
+        OpStats& s = op_stats[op];
+        s.calls.fetch_add(1, memory_order_relaxed);
+        if (failed) s.errors.fetch_add(1, memory_order_relaxed);
+        s.total_ns.fetch_add(ns, memory_order_relaxed);
+        s.buckets[hist_bucket(ns)].fetch_add(1, memory_order_relaxed);
+        uint64_t old = s.max_ns.load(memory_order_relaxed);
+        while (ns > old && !s.max_ns.compare_exchange_weak(old, ns, memory_order_relaxed)) {}
+    }
+};
+
+// value below which a fraction p of the calls is, from a copy of the buckets
+uint64_t hist_percentile(const vector<uint64_t>& buckets, uint64_t count, double p, uint64_t max_ns) {
+    uint64_t rank = max((uint64_t)1, (uint64_t)(p * count + 0.5));
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < HIST_BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) return min(hist_value(b), max_ns);
+    }
+    return max_ns;
+}
+
+string format_stats() {
+    string text;
+    char line[256];
+    snprintf(line, sizeof(line), "uptime %.1f s, %u nodes, indexing %s\n",
+             (now_ns() - mount_ns) / 1e9, node_count, index_done.load() ? "done" : "in progress");
+    text += line;
+    snprintf(line, sizeof(line), "%-10s %10s %8s %10s %10s %10s %10s %10s %10s\n",
+             "op (us)", "calls", "errors", "mean", "p50", "p90", "p99", "p99.9", "max");
+    text += line;
+    for (int op = 0; op < STAT_OPS; ++op) {
+        const OpStats& s = op_stats[op];
+        vector<uint64_t> buckets(HIST_BUCKETS);
+        uint64_t count = 0;
+        for (uint32_t b = 0; b < HIST_BUCKETS; ++b) { // the total follows the copy, calls may still be recorded
+            buckets[b] = s.buckets[b].load(memory_order_relaxed);
+            count += buckets[b];
+        }
+        uint64_t max_ns = s.max_ns.load(memory_order_relaxed);
+        snprintf(line, sizeof(line), "%-10s %10llu %8llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", stat_op_names[op],
+                 (unsigned long long)count, (unsigned long long)s.errors.load(memory_order_relaxed),
+                 count ? s.total_ns.load(memory_order_relaxed) / 1e3 / count : 0.0,
+                 hist_percentile(buckets, count, 0.5, max_ns) / 1e3, hist_percentile(buckets, count, 0.9, max_ns) / 1e3,
+                 hist_percentile(buckets, count, 0.99, max_ns) / 1e3, hist_percentile(buckets, count, 0.999, max_ns) / 1e3,
+                 max_ns / 1e3);
+        text += line;
+    }
+    uint64_t hits = cache_hits, misses = cache_misses;
+    snprintf(line, sizeof(line), "read: %llu bytes served\n", (unsigned long long)bytes_served.load());
+    text += line;
+    if (archive_mapped()) {
+        text += "cache: not used, reads come from the mapping of the archive\n";
+        return text;
+    }
+    snprintf(line, sizeof(line), "cache: %llu hits, %llu misses (%.1f%% hit), %llu blocks prefetched, %llu evicted\n",
+             (unsigned long long)hits, (unsigned long long)misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+             (unsigned long long)cache_prefetched.load(), (unsigned long long)cache_evicted.load());
+    text += line;
+    return text;
+}
+
+// SIGUSR1 is blocked in every thread (main blocks it before the session starts) and taken
+// here with sigwait, so the report is not written from a signal handler
+void* stats_thread_function(void* arg) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    while (true) {
+        int sig;
+        if (sigwait(&set, &sig) != 0 || stats_stop.load()) break;
+        string text = format_stats();
+        fwrite(text.data(), 1, text.size(), stderr);
+    }
+    return NULL;
+}
+
+// ---------------- FUSE low-level callbacks ----------------
+// The kernel names files by inode number, not by path: a node's inode is its index in nodes
+// (the root is FUSE_ROOT_ID). Nodes are never removed, so inodes stay valid for the whole mount
+// and forget needs no handling. Callbacks fill what they need under IndexGuard and reply after.
+
+// The archive is immutable, so the kernel may keep what it learned: names, attributes and
+// negative lookups for TARFS_CACHE_TIMEOUT seconds and file pages across opens (keep_cache).
+// A lookup that races the background indexer waits for it (IndexGuard), so even a negative
+// answer is final. Until indexing is done link counts are not, so nothing is cached before.
+// --no-kernel-cache turns this off, e.g. to compare callback counts.
+#define TARFS_CACHE_TIMEOUT 86400
+
+static inline uint32_t node_index(fuse_ino_t ino) {
+    return (ino >= FUSE_ROOT_ID && ino - FUSE_ROOT_ID < node_count) ? ino - FUSE_ROOT_ID : NIL_NODE;
+}
+
+static inline double cache_timeout() {
+    return (kernel_cache && index_done.load(memory_order_acquire)) ? TARFS_CACHE_TIMEOUT : 0;
+}
+
+void fill_stat(uint32_t index, struct stat* st) {
     memset(st, 0, sizeof(struct stat));
+    const FileNode& node = nodes[index];
+
+    st->st_ino = index + FUSE_ROOT_ID;
+    st->st_mode = node.mode;
+    st->st_size = node.size;
+    st->st_nlink = node.nlink;
+    if (S_ISCHR(node.mode) || S_ISBLK(node.mode)) st->st_rdev = node.offset;
+    st->st_uid = owners[node.owner].uid;
+    st->st_gid = owners[node.owner].gid;
 
-    FileNode* node = root->find_node(path);
-    if (node == NULL) {
-        return -ENOENT;
+    // the archive never changes under the mount: all three times are the member's mtime, so the
+    // attributes are the same on every call and the kernel may keep them (attr_timeout)
+    st->st_mtime = node.mtime;
+    st->st_atime = node.mtime;
+    st->st_ctime = node.mtime;
+}
+
+void fill_entry(uint32_t index, struct fuse_entry_param* entry) {
+    memset(entry, 0, sizeof(struct fuse_entry_param));
+    entry->ino = index + FUSE_ROOT_ID;
+    fill_stat(index, &entry->attr);
+    entry->attr_timeout = cache_timeout();
+    entry->entry_timeout = cache_timeout();
+}
+
+void fill_stats_stat(struct stat* st) {
+    memset(st, 0, sizeof(struct stat));
+    st->st_ino = STATS_INO;
+    st->st_mode = S_IFREG | 0444;
+    st->st_nlink = 1;
+    st->st_uid = getuid();
+    st->st_gid = getgid();
+    // size 0 like /proc: the content is made at open and read with direct_io until EOF
+}
+
+void my_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    OpTimer timer(STAT_LOOKUP);
+    struct fuse_entry_param entry;
+    memset(&entry, 0, sizeof(entry));
+    if (parent == FUSE_ROOT_ID && strcmp(name, STATS_NAME) == 0) {
+        entry.ino = STATS_INO;
+        fill_stats_stat(&entry.attr);
+        fuse_reply_entry(req, &entry);
+        return;
+    }
+    {
+        IndexGuard guard;
+        uint32_t dir = node_index(parent);
+        uint32_t index = (dir == NIL_NODE) ? NIL_NODE : guard.wait_for_child(dir, name);
+        if (index != NIL_NODE) {
+            fill_entry(index, &entry);
+        }
     }
+    // inode 0 is a negative entry, the kernel remembers the name is missing for entry_timeout
+    entry.entry_timeout = cache_timeout();
+    fuse_reply_entry(req, &entry);
+}
 
-    st->st_mode = node->mode;
-    st->st_size = node->size;
-    
-    // if (node->type == S_IFDIR) {
-    //     st->st_nlink = 2; // self and '.'
-    // } else {
-    //     st->st_nlink = 1;
-    // }
-    st->st_nlink = 0;
+void my_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    OpTimer timer(STAT_GETATTR);
+    struct stat st;
+    if (ino == STATS_INO) {
+        fill_stats_stat(&st);
+        fuse_reply_attr(req, &st, 0);
+        return;
+    }
+    uint32_t index;
+    {
+        IndexGuard guard;
+        index = node_index(ino);
+        if (index != NIL_NODE) {
+            guard.wait_for_node(index, false);
+            fill_stat(index, &st);
+        }
+    }
+    if (index == NIL_NODE) {
+        timer.fail();
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fuse_reply_attr(req, &st, cache_timeout());
+}
 
-    st->st_uid = node->uid;
-    st->st_gid = node->gid;
-    
-    st->st_mtime = node->mtime;
-    st->st_atime = time(NULL);
-    st->st_ctime = time(NULL);
+// readdir and readdirplus: entry k is ".", "..", then the children in archive order, and the
+// offset of an entry is k + 1, so a directory too big for one reply resumes right where it left
+// off without scanning again. plus: every entry comes with its attributes, no lookup per name
+void reply_dir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, bool plus) {
+    OpTimer timer(STAT_READDIR);
+    vector<char> buffer(size);
+    size_t used = 0;
+    int err = 0;
+    {
+        IndexGuard guard;
+        uint32_t index = node_index(ino);
+        if (index == NIL_NODE) {
+            err = ENOENT;
+        } else if (node_type(index) != S_IFDIR) {
+            err = ENOTDIR;
+        } else {
+            guard.wait_for_node(index, true);
+            const FileNode& dir = nodes[index];
+            const uint32_t* children = child_index + dir.first;
+            for (uint64_t k = max((off_t)0, offset); k < (uint64_t)dir.count + 2; ++k) {
+                uint32_t target = (k == 0) ? index : (k == 1) ? (dir.parent == NIL_NODE ? index : dir.parent) : children[k - 2];
+                const char* name = (k == 0) ? "." : (k == 1) ? ".." : node_name(target);
+                size_t n;
+#if FUSE_MAJOR_VERSION >= 3
+                if (plus) {
+                    struct fuse_entry_param entry;
+                    fill_entry(target, &entry);
+                    n = fuse_add_direntry_plus(req, buffer.data() + used, size - used, name, &entry, k + 1);
+                } else
+#endif
+                {
+                    struct stat st;
+                    memset(&st, 0, sizeof(st));
+                    st.st_ino = target + FUSE_ROOT_ID;
+                    st.st_mode = nodes[target].mode; // only the type is used
+                    n = fuse_add_direntry(req, buffer.data() + used, size - used, name, &st, k + 1);
+                }
+                if (n > size - used) break; // full, the next call starts at k
+                used += n;
+            }
+        }
+    }
+    if (err) {
+        timer.fail();
+        fuse_reply_err(req, err);
+        return;
+    }
+    fuse_reply_buf(req, buffer.data(), used);
+}
 
-    return 0; // success
+void my_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    reply_dir(req, ino, size, offset, false);
 }
-int my_read(const char *path, char *buffer, size_t size, off_t offset, struct fuse_file_info *fi) {
-    
-    FileNode* node = root->find_node(path);
-    if (node == NULL) {
-        return -ENOENT;
+
+#if FUSE_MAJOR_VERSION >= 3 // readdirplus is only in libfuse 3
+void my_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    reply_dir(req, ino, size, offset, true);
+}
+#endif
+
+void my_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    OpenFile* file = (OpenFile*)fi->fh;
+    if (file) {
+        pthread_mutex_destroy(&file->lock);
+        delete file;
     }
+    fi->fh = 0;
+    fuse_reply_err(req, 0);
+}
 
+void my_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    OpTimer timer(STAT_OPEN);
+    OpenFile* file = NULL;
+    int err = 0;
+    if (ino == STATS_INO) {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+            timer.fail();
+            fuse_reply_err(req, EACCES);
+            return;
+        }
+        file = new OpenFile;
+        file->index = NIL_NODE;
+        file->text = format_stats();
+        fi->fh = (uint64_t)file;
+        fi->direct_io = 1; // size 0 in getattr, the page cache would see an empty file
+        pthread_mutex_init(&file->lock, NULL);
+        if (fuse_reply_open(req, fi) == -ENOENT) {
+            pthread_mutex_destroy(&file->lock);
+            delete file;
+        }
+        return;
+    }
+    {
+        IndexGuard guard;
+        uint32_t index = node_index(ino);
+        if (index == NIL_NODE) {
+            err = ENOENT;
+        } else if (node_type(index) == S_IFDIR) {
+            err = EISDIR;
+        } else if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+            err = EACCES; // the archive is read only
+        } else {
+            // read / release get the node back without a lookup, and the handle carries the readahead state
+            file = new OpenFile;
+            file->index = index;
+            file->node = nodes[index];
+        }
+    }
+    if (err) {
+        timer.fail();
+        fuse_reply_err(req, err);
+        return;
+    }
+    pthread_mutex_init(&file->lock, NULL);
+    file->next_offset = file->node.offset;
+    file->window = 0;
+    file->prefetched_until = 0;
+    fi->fh = (uint64_t)file;
+    fi->keep_cache = kernel_cache; // pages read before stay valid, the content never changes
+    if (fuse_reply_open(req, fi) == -ENOENT) { // the open was interrupted, nobody will release it
+        pthread_mutex_destroy(&file->lock);
+        delete file;
+    }
+}
 
-    if (offset >= node->size) {
-        return 0; 
+// holes are zero filled without touching the archive, only the stored runs are read
+ssize_t read_sparse(const FileNode& node, uint64_t offset, char* buffer, size_t size) {
+    const SparseExtent* begin = sparse_extents + node.first;
+    const SparseExtent* end = begin + node.count;
+    // first extent that ends after offset
+    const SparseExtent* extent = upper_bound(begin, end, offset,
+                                             [](uint64_t value, const SparseExtent& e) { return value < e.logical + e.length; });
+    size_t done = 0;
+    while (done < size) {
+        uint64_t pos = offset + done;
+        if (extent == end || pos < extent->logical) {
+            uint64_t hole_end = (extent == end) ? offset + size : min(offset + size, extent->logical);
+            memset(buffer + done, 0, hole_end - pos);
+            done += hole_end - pos;
+            continue;
+        }
+        size_t n = min((uint64_t)(size - done), extent->logical + extent->length - pos);
+        ssize_t got = read_archive(extent->physical + (pos - extent->logical), buffer + done, n);
+        if (got < 0) return got;
+        done += got;
+        if ((size_t)got < n) break; // truncated archive
+        extent++;
     }
+    return done;
+}
+
+// data: where the bytes are, buffer or (mapped archive) the mapping itself
+ssize_t read_file(OpenFile* file, char* buffer, size_t size, off_t offset, const char** data) {
+    const FileNode& node = file->node;
+    *data = buffer;
 
-    if (offset + size > node->size) {
-        size = node->size - offset;
+    if (offset < 0 || (uint64_t)offset >= node.size) {
+        return 0;
     }
 
-    FILE *fp = fopen(tar_filename, "rb");
-    if (fp == NULL) {
-        return -errno; // 回傳系統錯誤碼
+    if (offset + size > node.size) {
+        size = node.size - offset;
     }
 
-    fseek(fp, node->offset + offset, SEEK_SET); 
-    
-    size_t bytes_read = fread(buffer, 1, size, fp);
-    
-    fclose(fp);
+    if (node.flags & NODE_SPARSE) {
+        IndexGuard guard; // the extent array still grows while indexing
+        return read_sparse(node, offset, buffer, size);
+    }
+    if (archive_mapped()) { // no copy at all, the reply is written from the mapping
+        uint64_t pos = node.offset + offset;
+        if (pos >= tar_map_size) return 0; // truncated archive
+        ssize_t n = min((uint64_t)size, tar_map_size - pos);
+        *data = tar_map + pos;
+        readahead(file, pos, n);
+        return n;
+    }
+    ssize_t n = read_archive(node.offset + offset, buffer, size);
+    if (n > 0) readahead(file, node.offset + offset, n);
+    return n;
+}
 
-    return bytes_read;
+void my_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    OpenFile* file = (OpenFile*)fi->fh;
+    if (file->index == NIL_NODE) { // the stats file is not counted in its own numbers
+        size_t start = min((size_t)max((off_t)0, offset), file->text.size());
+        fuse_reply_buf(req, file->text.data() + start, min(size, file->text.size() - start));
+        return;
+    }
+    OpTimer timer(STAT_READ);
+    unique_ptr<char[]> buffer(new char[size]); // not zeroed, read_file writes what it returns
+    const char* data;
+    ssize_t n = read_file(file, buffer.get(), size, offset, &data);
+    if (n < 0) {
+        timer.fail();
+        fuse_reply_err(req, -n);
+        return;
+    }
+    bytes_served.fetch_add(n, memory_order_relaxed);
+    fuse_reply_buf(req, data, n);
 }
-int my_readlink(const char *path, char *buffer, size_t size) {
-    FileNode* node = root->find_node(path);
-    if (node == NULL) {
-        return -ENOENT;
+
+void my_readlink(fuse_req_t req, fuse_ino_t ino) {
+    OpTimer timer(STAT_READLINK);
+    string target;
+    int err = 0;
+    {
+        IndexGuard guard; // the string pool still grows while indexing
+        uint32_t index = node_index(ino);
+        if (index == NIL_NODE) {
+            err = ENOENT;
+        } else if (node_type(index) != S_IFLNK) {
+            err = EINVAL;
+        } else {
+            target = string_pool + nodes[index].offset;
+        }
+    }
+    if (err) {
+        timer.fail();
+        fuse_reply_err(req, err);
+        return;
     }
+    fuse_reply_readlink(req, target.c_str());
+}
 
-    if (node->type != S_IFLNK) {
-        return -EINVAL;
+// request sizes for the multithreaded loop: big sequential reads and enough
+// queued background requests (readahead) to keep the worker threads busy
+#define TARFS_MAX_READ 131072 // 128 KiB
+#define TARFS_MAX_BACKGROUND 64
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+void my_init(void *userdata, struct fuse_conn_info *conn) {
+    conn->max_readahead = TARFS_MAX_READ;
+    conn->max_background = TARFS_MAX_BACKGROUND;
+    conn->congestion_threshold = TARFS_MAX_BACKGROUND * 3 / 4;
+
+    if (!index_done.load()) { // nothing to do when the sidecar index was loaded
+        index_thread_started = pthread_create(&index_thread, NULL, index_thread_function, NULL) == 0;
+        if (!index_thread_started) { // index right here, the mount just becomes ready later
+            index_thread_function(NULL);
+        }
     }
+    if (!archive_mapped()) start_prefetch_threads(); // a mapping is read ahead by the kernel
+    stats_thread_started = pthread_create(&stats_thread, NULL, stats_thread_function, NULL) == 0;
+}
 
-    snprintf(buffer, size, "%s", node->link_target);
+void my_destroy(void *userdata) {
+    index_stop.store(true);
+    if (index_thread_started) pthread_join(index_thread, NULL);
+    stop_prefetch_threads();
+    if (stats_thread_started) { // wake it up to let it see stats_stop
+        stats_stop.store(true);
+        pthread_kill(stats_thread, SIGUSR1);
+        pthread_join(stats_thread, NULL);
+    }
+    if (print_cache_stats) {
+        string text = format_stats();
+        fwrite(text.data(), 1, text.size(), stderr);
+    }
+}
 
-    return 0; // success
+// mount, daemonize (unless -f / -d) and run the session loop, multithreaded unless -s is given.
+// libfuse 2 and 3 only differ in how the session is put together
+int run_session(struct fuse_args* args, const struct fuse_lowlevel_ops* ops) {
+    int ret = -1;
+#if FUSE_MAJOR_VERSION >= 3
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(args, &opts) != 0) return -1;
+    if (!opts.mountpoint) {
+        fprintf(stderr, "[Error] no mount point\n");
+        return -1;
+    }
+    struct fuse_session* se = fuse_session_new(args, ops, sizeof(*ops), NULL);
+    if (se) {
+        if (fuse_set_signal_handlers(se) == 0) {
+            if (fuse_session_mount(se, opts.mountpoint) == 0) {
+                fuse_daemonize(opts.foreground);
+                ret = opts.singlethread ? fuse_session_loop(se) : fuse_session_loop_mt(se, opts.clone_fd);
+                fuse_session_unmount(se);
+            }
+            fuse_remove_signal_handlers(se);
+        }
+        fuse_session_destroy(se);
+    }
+    free(opts.mountpoint);
+#else
+    char* mountpoint = NULL;
+    int multithreaded = 0, foreground = 0;
+    if (fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) != 0) return -1;
+    if (!mountpoint) {
+        fprintf(stderr, "[Error] no mount point\n");
+        return -1;
+    }
+    struct fuse_chan* ch = fuse_mount(mountpoint, args);
+    if (ch) {
+        struct fuse_session* se = fuse_lowlevel_new(args, ops, sizeof(*ops), NULL);
+        if (se) {
+            if (fuse_set_signal_handlers(se) == 0) {
+                fuse_session_add_chan(se, ch);
+                fuse_daemonize(foreground);
+                ret = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+                fuse_remove_signal_handlers(se);
+                fuse_session_remove_chan(ch);
+            }
+            fuse_session_destroy(se);
+        }
+        fuse_unmount(mountpoint, ch);
+    }
+    free(mountpoint);
+#endif
+    return ret;
 }
 
-static struct fuse_operations op;
+static struct fuse_lowlevel_ops op;
 int main(int argc, char *argv[]) {
 
     memset(&op, 0, sizeof(op));
+    op.lookup = my_lookup;
     op.getattr = my_getattr;
     op.readdir = my_readdir;
+#if FUSE_MAJOR_VERSION >= 3
+    op.readdirplus = my_readdirplus;
+#endif
+    op.open = my_open;
     op.read = my_read;
+    op.release = my_release;
     op.readlink = my_readlink;
-    
-    // analyze tar for following functions
-    parse_tar_file();
+    op.init = my_init;
+    op.destroy = my_destroy;
+
+    // --dump-tree, --no-index-file, --no-kernel-cache, --cache-mb <n> and --cache-stats are ours, everything else goes to FUSE
+    int fuse_argc = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--dump-tree") == 0) dump_tree = true;
+        else if (strcmp(argv[i], "--no-index-file") == 0) use_sidecar = false;
+        else if (strcmp(argv[i], "--no-kernel-cache") == 0) kernel_cache = false;
+        else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            cache_blocks = max(1L, atol(argv[++i]) * 1024 * 1024 / CACHE_BLOCK);
+        }
+        else if (strcmp(argv[i], "--cache-stats") == 0) print_cache_stats = true;
+        else argv[fuse_argc++] = argv[i];
+    }
+    argv[fuse_argc] = NULL;
+    argc = fuse_argc;
+
+    // a valid sidecar index is used as is, otherwise the archive is analyzed in the background after the mount (my_init)
+    open_tar_archive();
+    sidecar_filename = string(tar_filename) + ".idx";
+    if (use_sidecar && load_sidecar()) {
+        index_done.store(true);
+        if (dump_tree) print_tree(ROOT_NODE);
+    } else {
+        init_tar_index();
+    }
 
-    root->print_tree();
+    // every thread started from here on inherits the mask, SIGUSR1 only reaches stats_thread
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+    mount_ns = now_ns();
 
-    // forward the functions to FUSE
-    return fuse_main(argc, argv, &op, NULL);
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    fuse_opt_add_arg(&args, "-omax_read=" TO_STRING(TARFS_MAX_READ));
+    int ret = run_session(&args, &op);
+    fuse_opt_free_args(&args);
+    return ret ? 1 : 0;
 }
 /*
-g++ 112550069.cpp -o 112550069.out `pkg-config fuse --cflags --libs`
+g++ 112550069.cpp -o 112550069.out `pkg-config fuse --cflags --libs` -lz -lzstd
+g++ 112550069.cpp -o 112550069.out `pkg-config fuse3 --cflags --libs` -lz -lzstd (libfuse 3: readdirplus, ls -l without a lookup per entry)
+g++ 112550069.cpp -o 112550069.out `pkg-config fuse --cflags --libs` -lz (without zstd.h: no .tar.zst)
+cp some.tar.gz test.tar (or .tar.zst, the format is detected by content)
 ./112550069.out -f tarfs
+./112550069.out -f tarfs --dump-tree (print the tree once indexing is done)
+./112550069.out -f tarfs --no-index-file (do not use or write test.tar.idx)
+./112550069.out -f tarfs --cache-mb 256 --cache-stats (block cache size for compressed or unmappable archives, print the statistics at unmount)
+cat tarfs/.tarfs-stats or kill -USR1 <pid> (calls, errors and latency percentiles per operation, bytes served, cache hits)
+./112550069.out -f tarfs --no-kernel-cache (kernel asks for every stat and read again)
+./bench_cache.sh ./112550069.out <some.tar> (callbacks reaching tarfs with and without kernel caching)
+./bench_read.sh ./112550069.out <some.tar> (parallel cat, multithreaded vs -s)
 */
\ No newline at end of file
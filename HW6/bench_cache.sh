@@ -0,0 +1,52 @@
+#! /bin/bash
+# kernel caching benchmark: mount a tar with FUSE debug output (-d), stat every entry and cat every
+# regular file a few times, then count the requests that reached tarfs, once with the default
+# entry/attr timeouts + keep_cache and once with --no-kernel-cache for comparison
+# usage: ./bench_cache.sh <program> <tar_file> [rounds]
+
+PROGRAM_PATH=$( readlink -f $1 )
+TAR_PATH=$( readlink -f $2 )
+ROUNDS=${3:-3}
+MOUNT_DIR="tarfs"
+FILE_LIST=$( mktemp )
+DEBUG_LOG=$( mktemp )
+
+if [ ! -x "${PROGRAM_PATH}" ] || [ ! -f "${TAR_PATH}" ]; then
+  echo "usage: $0 <program> <tar_file> [rounds]"
+  exit 1
+fi
+
+rm -f test.tar test.tar.idx
+cp ${TAR_PATH} test.tar
+mkdir -p ${MOUNT_DIR}
+
+for MODE in cached uncached; do
+  if [ ${MODE} = "uncached" ]; then
+    ${PROGRAM_PATH} -d ${MOUNT_DIR} --no-kernel-cache > /dev/null 2> ${DEBUG_LOG} &
+  else
+    ${PROGRAM_PATH} -d ${MOUNT_DIR} > /dev/null 2> ${DEBUG_LOG} &
+  fi
+  PROGRAM_PID=$!
+  sleep 1
+
+  find ${MOUNT_DIR} > ${FILE_LIST}
+  START=$( date +%s.%N )
+  for i in $( seq 1 ${ROUNDS} ); do
+    xargs -a ${FILE_LIST} -d '\n' stat > /dev/null
+    find ${MOUNT_DIR} -type f -exec cat {} + > /dev/null
+  done
+  END=$( date +%s.%N )
+
+  kill ${PROGRAM_PID}
+  wait ${PROGRAM_PID} 2> /dev/null
+
+  echo "[1;34m===== ${MODE}: $( wc -l < ${FILE_LIST} ) entries, ${ROUNDS} rounds =====[m"
+  awk -v start=${START} -v end=${END} 'BEGIN { printf "Seconds\t\t%.6f\n", end - start }'
+  echo -e "Opcode\t\tRequests"
+  for OPCODE in LOOKUP GETATTR READDIR READDIRPLUS OPEN READ; do
+    echo -e "${OPCODE}\t\t$( grep -c "opcode: ${OPCODE} " ${DEBUG_LOG} )"
+  done
+  echo -e "total\t\t$( grep -c 'opcode: ' ${DEBUG_LOG} )"
+done
+
+rm -f test.tar test.tar.idx ${FILE_LIST} ${DEBUG_LOG}
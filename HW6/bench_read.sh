@@ -0,0 +1,51 @@
+#! /bin/bash
+# concurrent read benchmark: mount a tar and cat every regular file with 1, 2, 4 ... parallel readers,
+# once with the multithreaded FUSE loop and once single threaded (-s) for comparison. Both mounts use
+# --no-kernel-cache, otherwise every pass after the first is served from the kernel page cache
+# usage: ./bench_read.sh <program> <tar_file> [max_jobs]
+
+PROGRAM_PATH=$( readlink -f $1 )
+TAR_PATH=$( readlink -f $2 )
+MAX_JOBS=${3:-$( nproc )}
+MOUNT_DIR="tarfs"
+FILE_LIST=$( mktemp )
+
+if [ ! -x "${PROGRAM_PATH}" ] || [ ! -f "${TAR_PATH}" ]; then
+  echo "usage: $0 <program> <tar_file> [max_jobs]"
+  exit 1
+fi
+
+rm -f test.tar test.tar.idx
+cp ${TAR_PATH} test.tar
+mkdir -p ${MOUNT_DIR}
+
+for MODE in multi single; do
+  if [ ${MODE} = "single" ]; then
+    ${PROGRAM_PATH} -f -s ${MOUNT_DIR} --no-kernel-cache > /dev/null &
+  else
+    ${PROGRAM_PATH} -f ${MOUNT_DIR} --no-kernel-cache > /dev/null &
+  fi
+  PROGRAM_PID=$!
+  sleep 1
+
+  find ${MOUNT_DIR} -type f > ${FILE_LIST}
+  TOTAL_BYTES=$( xargs -a ${FILE_LIST} -d '\n' stat -c %s | awk '{ sum += $1 } END { print sum + 0 }' )
+  echo "[1;34m===== ${MODE} threaded: $( wc -l < ${FILE_LIST} ) files, ${TOTAL_BYTES} bytes =====[m"
+  echo -e "Jobs\tSeconds\t\tMB/s"
+
+  JOBS=1
+  while [ ${JOBS} -le ${MAX_JOBS} ]; do
+    # no keep_cache, so every open goes back to tarfs instead of the page cache
+    START=$( date +%s.%N )
+    xargs -a ${FILE_LIST} -d '\n' -P ${JOBS} -n 16 cat > /dev/null
+    END=$( date +%s.%N )
+    awk -v jobs=${JOBS} -v start=${START} -v end=${END} -v bytes=${TOTAL_BYTES} \
+      'BEGIN { sec = end - start; printf "%d\t%.6f\t%.1f\n", jobs, sec, (sec > 0) ? bytes / sec / 1e6 : 0 }'
+    JOBS=$(( JOBS * 2 ))
+  done
+
+  kill ${PROGRAM_PID}
+  wait ${PROGRAM_PID} 2> /dev/null
+done
+
+rm -f test.tar test.tar.idx ${FILE_LIST}
@@ -6,7 +6,7 @@ OUTPUT_DIR="output"
 ANSWER_DIR="answer"
 PROGRAM_PATH=$( readlink -f $1 )
 
-rm -f ${OUTPUT_DIR}/* test.tar
+rm -f ${OUTPUT_DIR}/* test.tar test.tar.idx
 
 cp tar/basic.tar test.tar
 
@@ -27,7 +27,7 @@ for i in $( seq 1 4 ); do
 done
 
 kill ${PROGRAM_PID}
-rm -f test.tar
+rm -f test.tar test.tar.idx
 
 cp tar/softlink.tar test.tar
 
@@ -47,7 +47,7 @@ for i in $( seq 5 6 ); do
   fi
 done
 kill ${PROGRAM_PID}
-rm -f test.tar
+rm -f test.tar test.tar.idx
 echo "[1;33m======= Summary =======[m"
 [ -n "${correct_cases}" ] && echo "[0;32m[Correct][m:${correct_cases}"
 [ -n "${wrong_cases}" ] && echo "[0;31m[ Wrong ][m:${wrong_cases}"